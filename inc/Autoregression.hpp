@@ -43,6 +43,23 @@ enum RotateDirection {
  */
 static int autoregression_seed = 334340;
 
+/**
+ * The generator of the noise of predict, shared by all its instantiations. It starts with the
+ * autoregression_seed.
+ */
+inline boost::mt19937 & autoregression_generator() {
+	static boost::mt19937 random_number_generator(autoregression_seed);
+	return random_number_generator;
+}
+
+/**
+ * Restart the noise of predict with another seed, for example for independent replicates of an
+ * experiment. Note that drand48 (srand48) is a separate source.
+ */
+inline void seed_autoregression(unsigned int seed) {
+	autoregression_generator().seed(seed);
+}
+
 /**
  * Predict the next value using auto-regression (AR).
  * See also: http://en.wikipedia.org/wiki/Autoregressive_model which describes an autoregressive
@@ -65,10 +82,9 @@ inline T predict(InputIterator1 first1, InputIterator1 last1,
 	__glibcxx_requires_valid_range(first1, last1);
 
 	//	assert (container.size() == coefficients.size());
-	static boost::mt19937 random_number_generator(autoregression_seed);
 	boost::normal_distribution<> normal_dist(0.0, variance);
 	boost::variate_generator<boost::mt19937&, boost::normal_distribution<> > epsilon(
-			random_number_generator, normal_dist);
+			autoregression_generator(), normal_dist);
 
 	T sum = std::inner_product(first1, last1, first2, T(0));
 	T prediction = constant + sum + epsilon();
@@ -78,6 +94,23 @@ inline T predict(InputIterator1 first1, InputIterator1 last1,
 	return prediction;
 }
 
+/**
+ * The deterministic part of predict: the expected next value of the AR process, without noise. This
+ * can be used with noise from another source, for example a low-discrepancy sequence.
+ * @param container			input values x[t-1], x[t-2], x[t-3], ...
+ * @param coefficient		parameters of the autoregressive model phi[i], phi[2], phi[3], ...
+ * @param constant			(optional) a constant as in the definition
+ * @return 					expected next value E(x[t])
+ */
+template<typename InputIterator1, typename InputIterator2, typename T>
+inline T predict_mean(InputIterator1 first1, InputIterator1 last1,
+		InputIterator2 first2, T constant) {
+	__glibcxx_function_requires(_InputIteratorConcept<InputIterator1>);
+	__glibcxx_function_requires(_InputIteratorConcept<InputIterator2>);
+	__glibcxx_requires_valid_range(first1, last1);
+	return constant + std::inner_product(first1, last1, first2, T(0));
+}
+
 /**
  * A vector is not the best format to implement a circular buffer. However, sometimes a
  * vector is required for other purposes and then an "advance" method is interesting, it
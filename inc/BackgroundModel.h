@@ -0,0 +1,138 @@
+/**
+ * @brief Per-pixel background model with foreground mask
+ * @file BackgroundModel.h
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+
+#ifndef BACKGROUNDMODEL_H_
+#define BACKGROUNDMODEL_H_
+
+#include <ProbMatrix.h>
+#include <CImg.h>
+
+using namespace cimg_library;
+
+/* **************************************************************************************
+ * Interface of BackgroundModel
+ * **************************************************************************************/
+
+/**
+ * A background model for a static camera. Like the per-pixel tables in ProbMatrix every pixel
+ * has its own statistics, here a running Gaussian over the intensity (the mean of the channels):
+ *   mean = mean + alpha (I - mean)
+ *   var  = var  + alpha ((I - mean)^2 - var)
+ * A pixel is foreground if it is more than "threshold" standard deviations away from its mean.
+ * Only background pixels update the model, so an object that stands still is not absorbed into
+ * the background immediately.
+ *
+ * Once per frame this produces a foreground mask and its integral image, after which the fraction
+ * of foreground pixels in any rectangle takes four lookups. The first frame initializes the model
+ * and has no foreground.
+ */
+class BackgroundModel {
+public:
+	/**
+	 * Constructor BackgroundModel
+	 * @param learning_rate		the step size alpha of the running mean and variance
+	 * @param threshold			number of standard deviations for a pixel to be foreground
+	 * @param min_variance		lower bound on the variance, against noise-free (e.g. saturated) pixels
+	 */
+	BackgroundModel(Value learning_rate = 0.05, Value threshold = 2.5, Value min_variance = 16);
+
+	//! Destructor ~BackgroundModel
+	virtual ~BackgroundModel();
+
+	/**
+	 * Classify all pixels of the frame and update the model with the background pixels. Memory is
+	 * only reallocated (and the model restarted) if the size of the frame changes.
+	 */
+	void Update(CImg<DataValue> & frame);
+
+	//! Restart the model with the next frame
+	void Reset();
+
+	//! Number of frames in the model
+	inline int getFrameCount() { return frame_count; }
+
+	//! Width of the last frame
+	inline int getWidth() { return width; }
+
+	//! Height of the last frame
+	inline int getHeight() { return height; }
+
+	//! The foreground mask (1 for foreground, 0 for background) of the last frame, row by row
+	inline const DataValue * getMask() { return mask; }
+
+	/**
+	 * Get the number of foreground pixels in the rectangle [x0,x1]x[y0,y1] (inclusive). Pixels
+	 * outside of the frame are background.
+	 */
+	int getForeground(int x0, int y0, int x1, int y1);
+
+	/**
+	 * Get the fraction of foreground pixels in the rectangle [x0,x1]x[y0,y1] (inclusive).
+	 */
+	Value getCoverage(int x0, int y0, int x1, int y1);
+
+protected:
+	//! Allocate memory for a frame of given size
+	void Allocate(int width, int height);
+
+	//! Deallocate all structures
+	void Clear();
+
+private:
+	//! Step size of the running mean and variance
+	Value learning_rate;
+
+	//! Threshold in standard deviations
+	Value threshold;
+
+	//! Minimum variance per pixel
+	Value min_variance;
+
+	//! Width of the frame
+	int width;
+
+	//! Height of the frame
+	int height;
+
+	//! Number of frames seen by the model
+	int frame_count;
+
+	//! Running mean per pixel
+	Value *mean;
+
+	//! Running variance per pixel
+	Value *variance;
+
+	//! Foreground mask per pixel
+	DataValue *mask;
+
+	//! Integral image of the mask of size (width+1)*(height+1)
+	HistogramValue *integral;
+
+	//! Not copyable (owns the frame-sized arrays)
+	BackgroundModel(const BackgroundModel &);
+	BackgroundModel & operator=(const BackgroundModel &);
+};
+
+#endif /* BACKGROUNDMODEL_H_ */
@@ -0,0 +1,106 @@
+/**
+ * @brief Per-frame color space conversion for planar images
+ * @file ColorSpace.h
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+
+#ifndef COLORSPACE_H_
+#define COLORSPACE_H_
+
+#include <ProbMatrix.h>
+#include <CImg.h>
+
+using namespace cimg_library;
+
+/**
+ * The color spaces the converter knows about. The output always has three 8-bit channels
+ * in the range [0,255], so it can be binned by Histogram::value2bin as before.
+ *   CS_RGB:				no conversion, the frame is passed on as is
+ *   CS_HSV:				hue, saturation, value (hue scaled to [0,255))
+ *   CS_YCBCR:				luma and chroma as in JPEG (full range)
+ *   CS_NORMALIZED_RG:		chromaticity r=R/(R+G+B), g=G/(R+G+B), plus intensity (R+G+B)/3
+ */
+enum ColorSpace {
+	CS_RGB,
+	CS_HSV,
+	CS_YCBCR,
+	CS_NORMALIZED_RG,
+	CS_TYPES
+};
+
+/* **************************************************************************************
+ * Interface of ColorSpaceConverter
+ * **************************************************************************************/
+
+/**
+ * Converts an entire RGB frame into another color space. This is meant to run once per frame
+ * ahead of the likelihood calculations, and not per particle. The CImg layout is planar (first
+ * all red values, then all green values, then all blue values), so every conversion is a
+ * single loop over three input and three output planes. These loops are written without
+ * aliasing and with branches as selects, so the compiler can vectorize them.
+ *
+ * The result is cached internally and is reused (without reallocation) for the next frame of
+ * the same size.
+ */
+class ColorSpaceConverter {
+public:
+	//! Constructor ColorSpaceConverter
+	ColorSpaceConverter(ColorSpace color_space = CS_RGB);
+
+	//! Destructor ~ColorSpaceConverter
+	virtual ~ColorSpaceConverter();
+
+	//! Set the color space to convert to
+	inline void setColorSpace(ColorSpace color_space) { this->color_space = color_space; }
+
+	//! Get the color space to convert to
+	inline ColorSpace getColorSpace() { return color_space; }
+
+	/**
+	 * Convert a frame. If no conversion is necessary (CS_RGB or less than three channels) the
+	 * frame itself is returned, otherwise a reference to the internally cached result.
+	 * @param frame			an RGB image (planar, 8-bit)
+	 * @return				the image in the requested color space
+	 */
+	CImg<DataValue> & Convert(CImg<DataValue> & frame);
+
+protected:
+	//! JPEG YCbCr in fixed-point arithmetic
+	void convertYCbCr(const DataValue *r, const DataValue *g, const DataValue *b,
+			DataValue *y, DataValue *cb, DataValue *cr, int size);
+
+	//! Hue, saturation and value
+	void convertHSV(const DataValue *r, const DataValue *g, const DataValue *b,
+			DataValue *h, DataValue *s, DataValue *v, int size);
+
+	//! Chromaticity coordinates plus intensity
+	void convertNormalizedRG(const DataValue *r, const DataValue *g, const DataValue *b,
+			DataValue *nr, DataValue *ng, DataValue *i, int size);
+
+private:
+	//! The color space to convert to
+	ColorSpace color_space;
+
+	//! Cached result of the last conversion
+	CImg<DataValue> converted;
+};
+
+#endif /* COLORSPACE_H_ */
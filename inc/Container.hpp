@@ -409,6 +409,73 @@ T distance(InputIterator1 first1, InputIterator1 last1, InputIterator2 first2, I
 	}
 }
 
+/**
+ * The same as distance(), but the accumulation is abandoned as soon as the distance is known to be larger than
+ * "cutoff". If the distance is at most "cutoff" it is returned exactly, otherwise a lower bound on the distance
+ * that is larger than "cutoff" is returned. The partial sums are monotone for:
+ *   DM_EUCLIDEAN, DM_HELLINGER, DM_MANHATTAN, DM_CHEBYSHEV
+ * For DM_BHATTACHARYYA and DM_SQUARED_HELLINGER the partial sum of the Bhattacharyya coefficient is increasing
+ * instead. The rest of the coefficient is bounded by Cauchy-Schwarz:
+ *   sum_{i>k} sqrt (x_i*y_i) <= sqrt (sum_{i>k} x_i * sum_{i>k} y_i)
+ * in which the remaining mass of both containers follows from them being normalized (summing to one). This bound
+ * is only valid for normalized containers, such as the normalized histograms! For the other metrics (dot product
+ * and Bhattacharyya coefficient, which are similarities) there is no early abandoning.
+ * @param cutoff			distance above which the exact value is not of interest
+ * @return				the distance, or a lower bound above cutoff
+ */
+template<typename T, typename InputIterator1, typename InputIterator2>
+T distance_bounded(InputIterator1 first1, InputIterator1 last1, InputIterator2 first2, InputIterator2 last2,
+		DistanceMetric metric, T cutoff) {
+	__glibcxx_function_requires(_InputIteratorConcept<InputIterator1>);
+	__glibcxx_function_requires(_InputIteratorConcept<InputIterator2>);
+	__glibcxx_requires_valid_range(first1, last1);
+	__glibcxx_requires_valid_range(first2, last2);
+	assert (std::distance(first2,last2) == std::distance(first1,last1));
+	T sum = T(0);
+	switch (metric) {
+	case DM_BHATTACHARYYA: case DM_SQUARED_HELLINGER: {
+		// the coefficient needs to stay above this value to have a distance below the cutoff
+		T min_coefficient = (metric == DM_BHATTACHARYYA) ? std::exp(-cutoff) : T(1) - cutoff * cutoff;
+		T rest1 = T(1), rest2 = T(1);
+		for (; first1 != last1; ++first1, ++first2) {
+			sum += battacharyya<T>(*first1, *first2);
+			rest1 -= *first1;
+			rest2 -= *first2;
+			T bound = sum + std::sqrt(std::max(rest1, T(0)) * std::max(rest2, T(0)));
+			if (bound < min_coefficient) {
+				sum = bound;
+				break;
+			}
+		}
+		if (metric == DM_BHATTACHARYYA) return -std::log(sum);
+		return std::sqrt(std::max(T(1) - sum, T(0)));
+	}
+	case DM_EUCLIDEAN: case DM_HELLINGER: {
+		T max_sum = (metric == DM_EUCLIDEAN) ? cutoff * cutoff : T(2) * cutoff * cutoff;
+		for (; first1 != last1; ++first1, ++first2) {
+			sum += (metric == DM_EUCLIDEAN) ? euclidean<T>(*first1, *first2) : hellinger<T>(*first1, *first2);
+			if (sum > max_sum) break;
+		}
+		if (metric == DM_EUCLIDEAN) return std::sqrt(sum);
+		return std::sqrt(sum) / std::sqrt(2);
+	}
+	case DM_MANHATTAN:
+		for (; first1 != last1; ++first1, ++first2) {
+			sum += taxicab<T>(*first1, *first2);
+			if (sum > cutoff) break;
+		}
+		return sum;
+	case DM_CHEBYSHEV:
+		for (; first1 != last1; ++first1, ++first2) {
+			sum = max<T>()(sum, taxicab<T>(*first1, *first2));
+			if (sum > cutoff) break;
+		}
+		return sum;
+	default:
+		return distance<T>(first1, last1, first2, last2, metric);
+	}
+}
+
 /**
  * Provide a similar template function, but now with containers instead of iterators. Be careful that now the
  * typename Point is not checked for having actually "begin() and end()" operators.
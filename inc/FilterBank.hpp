@@ -0,0 +1,286 @@
+/**
+ * @brief Many small particle filters of the same type, run in lockstep on one block of memory
+ * @file FilterBank.hpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+
+#ifndef FILTERBANK_HPP_
+#define FILTERBANK_HPP_
+
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+
+#include <WorkerPool.hpp>
+
+//! Minimum number of particles per piece of work of a filter bank on the worker pool
+#define BANK_GRAIN 4096
+
+/* **************************************************************************************
+ * Interface of FilterBank
+ * **************************************************************************************/
+
+/**
+ * A bank of K particle filters with the same state (D numbers of type T) and the same number of
+ * particles N. A ParticleFilter with only a hundred particles spends much of its time on overhead: a
+ * virtual call and a heap-allocated state per particle, sorting on resampling, small vectors. The
+ * bank instead keeps the particles of all filters in one structure of arrays: column d holds value d
+ * of the state of all K*N particles, filter after filter, so the particles of filter k are the indices
+ * [k*N, (k+1)*N). The weights are a single array in the same order.
+ *
+ * Tick runs the transition, the likelihood and the resampling of all filters in lockstep. Transition
+ * and Likelihood are called for ranges of whole filters, without a pool once for the entire bank,
+ * so their inner loops run over long arrays of plain numbers that the compiler can vectorize across
+ * filters. With a worker pool (see SetWorkerPool) the filters are cut in pieces of at least
+ * BANK_GRAIN particles, and every piece goes through all three steps on the same thread while its
+ * particles are in the cache.
+ *
+ * Transition and Likelihood are called concurrently for disjoint ranges, so they may only write to the
+ * particles in their range. Random numbers should come from the generator of the filter (see getSeed),
+ * then the result does not depend on the number of threads.
+ */
+template <int D, typename T = float>
+class FilterBank {
+public:
+	/**
+	 * Constructor FilterBank
+	 * @param filters		the number of filters K
+	 * @param particles		the number of particles N of every filter
+	 */
+	FilterBank(int filters, int particles): filters(filters), particles(particles), pool(NULL) {
+		assert (filters > 0 && particles > 0);
+		int size = filters * particles;
+		state.resize(D * size);
+		scratch.resize(D * size);
+		sources.resize(size);
+		weights.resize(size, 1.0 / particles);
+		means.resize(filters * D, 0);
+		ess.resize(filters, 1);
+		totals.resize(filters, 0);
+		offsets.resize(filters, 0);
+		seeds.resize(filters * 3);
+		for (int k = 0; k < filters; ++k) {
+			Seed(k, lrand48());
+		}
+	}
+
+	//! Destructor ~FilterBank
+	virtual ~FilterBank() {}
+
+	//! Use a pool of worker threads (not owned), NULL to use the calling thread
+	inline void SetWorkerPool(WorkerPool *pool) { this->pool = pool; }
+
+	//! The number of filters
+	inline int getFilters() { return filters; }
+
+	//! The number of particles of every filter
+	inline int getParticles() { return particles; }
+
+	//! Column d of the state of all particles of all filters
+	inline T * getColumn(int d) { return &state[d * filters * particles]; }
+
+	//! The weights of all particles of all filters
+	inline double * getWeights() { return &weights[0]; }
+
+	//! The filter a particle belongs to
+	inline int getFilter(int index) { return index / particles; }
+
+	/**
+	 * Spread the particles of a filter uniformly around a mean.
+	 * @param filter		the filter
+	 * @param mean			D values
+	 * @param spread		D half-widths of the uniform distribution
+	 */
+	void Init(int filter, const T *mean, const T *spread) {
+		assert (filter >= 0 && filter < filters);
+		unsigned short *seed = getSeed(filter);
+		for (int d = 0; d < D; ++d) {
+			T *column = getColumn(d) + filter * particles;
+			for (int i = 0; i < particles; ++i) {
+				column[i] = mean[d] + spread[d] * (2 * erand48(seed) - 1);
+			}
+			means[filter * D + d] = mean[d];
+		}
+		std::fill_n(&weights[filter * particles], particles, 1.0 / particles);
+		ess[filter] = 1;
+		totals[filter] = 0;
+	}
+
+	//! Restart the random number generator of a filter
+	void Seed(int filter, long seed) {
+		unsigned short *s = getSeed(filter);
+		s[0] = 0x330E;
+		s[1] = (unsigned short)seed;
+		s[2] = (unsigned short)(seed >> 16);
+	}
+
+	/**
+	 * Transition, likelihood and systematic resampling of all filters. The offsets of the resampling are
+	 * drawn here, from the random number generator of every filter.
+	 */
+	void Tick() {
+		for (int k = 0; k < filters; ++k) {
+			offsets[k] = erand48(getSeed(k));
+		}
+		Stepper stepper(*this);
+		int grain = std::max(1, BANK_GRAIN / particles);
+		if (pool != NULL) {
+			pool->Run(stepper, filters, grain);
+		} else {
+			stepper.Run(0, filters);
+		}
+		state.swap(scratch);
+	}
+
+	//! The weighted mean of value d of the state of a filter at the last resampling step
+	inline double GetMean(int filter, int d) { return means[filter * D + d]; }
+
+	//! The effective sample size of a filter at the last resampling step, as fraction of N
+	inline double GetEss(int filter) { return ess[filter]; }
+
+	//! The sum of the likelihoods of a filter at the last resampling step, 0 if the filter lost track
+	inline double GetTotal(int filter) { return totals[filter]; }
+
+protected:
+	/**
+	 * Move the particles [begin,end) of whole filters.
+	 */
+	virtual void Transition(int begin, int end) = 0;
+
+	/**
+	 * Write the likelihood of the particles [begin,end) of whole filters to their weights.
+	 */
+	virtual void Likelihood(int begin, int end) = 0;
+
+	//! The random number generator of a filter, for erand48 and Normal
+	inline unsigned short * getSeed(int filter) { return &seeds[filter * 3]; }
+
+	//! A standard normal number (Box-Muller)
+	static inline double Normal(unsigned short *seed) {
+		double u = 1 - erand48(seed);
+		double v = erand48(seed);
+		return std::sqrt(-2 * std::log(u)) * std::cos(2 * M_PI * v);
+	}
+
+	/**
+	 * Normalize the weights of a filter, estimate its mean, and draw N particles with systematic
+	 * resampling into the scratch columns. There is no sorting: the points (u+i)/N are drawn in the order
+	 * of the particles. A filter whose weights sum to zero keeps its particles.
+	 * @param filter		the filter
+	 * @param source		room for N indices
+	 */
+	void Resample(int filter, int *source) {
+		int p0 = filter * particles, p1 = p0 + particles;
+		double total = 0, squared = 0;
+		for (int i = p0; i < p1; ++i) total += weights[i];
+		totals[filter] = total;
+		if (!(total > 0)) {
+			for (int d = 0; d < D; ++d) {
+				std::copy(&state[d * filters * particles + p0], &state[d * filters * particles + p1],
+						&scratch[d * filters * particles + p0]);
+			}
+			std::fill_n(&weights[p0], particles, 1.0 / particles);
+			return;
+		}
+		for (int d = 0; d < D; ++d) {
+			const T *column = &state[d * filters * particles];
+			double mean = 0;
+			for (int i = p0; i < p1; ++i) mean += weights[i] * column[i];
+			means[filter * D + d] = mean / total;
+		}
+		for (int i = p0; i < p1; ++i) {
+			weights[i] /= total;
+			squared += weights[i] * weights[i];
+		}
+		ess[filter] = 1 / (squared * particles);
+
+		double cumulative = weights[p0];
+		int j = p0;
+		for (int i = 0; i < particles; ++i) {
+			double u = (i + offsets[filter]) / particles;
+			while (u > cumulative && j < p1 - 1) {
+				cumulative += weights[++j];
+			}
+			source[i] = j;
+		}
+		for (int d = 0; d < D; ++d) {
+			const T *from = &state[d * filters * particles];
+			T *to = &scratch[d * filters * particles + p0];
+			for (int i = 0; i < particles; ++i) to[i] = from[source[i]];
+		}
+		std::fill_n(&weights[p0], particles, 1.0 / particles);
+	}
+
+private:
+	//! Runs the steps for a range of filters
+	class Stepper: public WorkerTask {
+	public:
+		Stepper(FilterBank & bank): bank(bank) {}
+		void Run(int begin, int end) {
+			int N = bank.particles;
+			bank.Transition(begin * N, end * N);
+			bank.Likelihood(begin * N, end * N);
+			for (int k = begin; k < end; ++k) bank.Resample(k, &bank.sources[k * N]);
+		}
+	private:
+		FilterBank & bank;
+	};
+
+	//! Number of filters
+	int filters;
+
+	//! Number of particles per filter
+	int particles;
+
+	//! The columns of the state, one after the other
+	std::vector<T> state;
+
+	//! The columns the particles are resampled into, swapped with state afterwards
+	std::vector<T> scratch;
+
+	//! Room for the N indices drawn by the resampling of every filter
+	std::vector<int> sources;
+
+	//! The weights of all particles
+	std::vector<double> weights;
+
+	//! Weighted mean per filter and column
+	std::vector<double> means;
+
+	//! Effective sample size per filter
+	std::vector<double> ess;
+
+	//! Sum of the likelihoods per filter
+	std::vector<double> totals;
+
+	//! Offset of the systematic resampling per filter
+	std::vector<double> offsets;
+
+	//! State of erand48 per filter
+	std::vector<unsigned short> seeds;
+
+	//! Worker threads (not owned)
+	WorkerPool *pool;
+};
+
+#endif /* FILTERBANK_HPP_ */
@@ -0,0 +1,187 @@
+/**
+ * @brief Fixed-lag smoother over the ancestry of particles
+ * @file FixedLagSmoother.hpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common 
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from 
+ * thread pools and TCP/IP components to control architectures and learning algorithms. 
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory 
+ * farming, for animal experimentation, or anything that violates the Universal 
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+
+#ifndef FIXEDLAGSMOOTHER_HPP_
+#define FIXEDLAGSMOOTHER_HPP_
+
+#include <vector>
+#include <cassert>
+
+/* **************************************************************************************
+ * Interface of FixedLagSmoother
+ * **************************************************************************************/
+
+/**
+ * A ring buffer with the last "lag"+1 generations of a particle filter. Per generation it stores for
+ * every particle a snapshot of its state (a POD struct, not the state itself), its weight and the
+ * index of its parent in the previous generation. Following the parents from the current generation
+ * back gives the lineage of every particle, and weighting these with the current weights gives the
+ * fixed-lag smoothed estimate of the state "lag" generations ago:
+ *   E(x[t-L] | z[0..t]) = sum_k w[t]_k x[t-L]_{a(k)}
+ * with a(k) the ancestor of particle k at time t-L. Because of resampling the lineages coalesce, which
+ * is why the lag should be kept short.
+ *
+ * All memory, (lag+1) * particles * (sizeof(Snapshot) + sizeof(double) + sizeof(int)), is allocated by
+ * Configure. Adding a generation overwrites the oldest one and does not allocate.
+ */
+template <typename Snapshot>
+class FixedLagSmoother {
+public:
+	//! Constructor FixedLagSmoother, call Configure before use
+	FixedLagSmoother(): lag(0), particles(0), generations(0), head(0) {}
+
+	//! Destructor ~FixedLagSmoother
+	virtual ~FixedLagSmoother() {}
+
+	/**
+	 * Allocate the buffer and forget all generations.
+	 * @param lag			number of generations to look back
+	 * @param particles		number of particles per generation
+	 */
+	void Configure(int lag, int particles) {
+		assert (lag >= 0 && particles > 0);
+		this->lag = lag;
+		this->particles = particles;
+		int size = (lag + 1) * particles;
+		snapshots.resize(size);
+		weights.resize(size);
+		parents.resize(size);
+		generations = 0;
+		head = 0;
+	}
+
+	//! Forget all generations, keep the memory
+	inline void Clear() { generations = 0; head = 0; }
+
+	//! The number of generations that can be looked back
+	inline int getLag() { return lag; }
+
+	//! The number of particles per generation
+	inline int getParticles() { return particles; }
+
+	//! The number of generations that are stored (at most lag+1)
+	inline int getGenerations() { return generations; }
+
+	//! The memory in bytes that is used for the buffer
+	inline size_t getMemoryFootprint() {
+		return snapshots.size() * (sizeof(Snapshot) + sizeof(double) + sizeof(int));
+	}
+
+	/**
+	 * Start a new generation, which overwrites the oldest one if the buffer is full. Fill it with Set
+	 * for all particles.
+	 */
+	void Next() {
+		assert (particles > 0);
+		head = (generations == 0) ? 0 : (head + 1) % (lag + 1);
+		if (generations < lag + 1) generations++;
+	}
+
+	/**
+	 * Set a particle in the current generation.
+	 * @param particle		index of the particle
+	 * @param snapshot		its state
+	 * @param weight		its (normalized) weight
+	 * @param parent		index of its parent in the previous generation (-1 if unknown)
+	 */
+	inline void Set(int particle, const Snapshot & snapshot, double weight, int parent) {
+		assert (particle >= 0 && particle < particles);
+		int i = head * particles + particle;
+		snapshots[i] = snapshot;
+		weights[i] = weight;
+		parents[i] = parent;
+	}
+
+	/**
+	 * Get the ancestor of a particle of the current generation a number of generations ago.
+	 * @return				the index of the ancestor, or -1 if the lineage is not known that far back
+	 */
+	int getAncestor(int particle, int back) {
+		assert (back >= 0 && back <= lag);
+		if (back >= generations) return -1;
+		int g = head;
+		for (int b = 0; b < back && particle >= 0; ++b) {
+			particle = parents[g * particles + particle];
+			g = (g + lag) % (lag + 1);
+		}
+		return particle;
+	}
+
+	//! Get the snapshot of a particle a number of generations ago (in the indices of that generation)
+	inline const Snapshot & getSnapshot(int particle, int back) {
+		assert (back >= 0 && back < generations);
+		int g = (head + (lag + 1) - back) % (lag + 1);
+		return snapshots[g * particles + particle];
+	}
+
+	//! Get the weight of a particle in the current generation
+	inline double getWeight(int particle) { return weights[head * particles + particle]; }
+
+	/**
+	 * Get the lineage of a particle of the current generation, oldest first. The trajectory should have
+	 * room for getGenerations() snapshots.
+	 * @return				the number of snapshots written (less if the lineage is not known that far back)
+	 */
+	int getLineage(int particle, Snapshot *trajectory) {
+		int g = head;
+		int count = 0;
+		for (int b = 0; b < generations && particle >= 0; ++b) {
+			trajectory[b] = snapshots[g * particles + particle];
+			particle = parents[g * particles + particle];
+			g = (g + lag) % (lag + 1);
+			count++;
+		}
+		// reverse so the oldest comes first
+		for (int i = 0; i < count / 2; ++i) {
+			Snapshot tmp = trajectory[i];
+			trajectory[i] = trajectory[count - 1 - i];
+			trajectory[count - 1 - i] = tmp;
+		}
+		return count;
+	}
+
+private:
+	//! Number of generations to look back
+	int lag;
+
+	//! Number of particles per generation
+	int particles;
+
+	//! Number of generations stored
+	int generations;
+
+	//! Slot of the current generation
+	int head;
+
+	//! Snapshots, generation by generation
+	std::vector<Snapshot> snapshots;
+
+	//! Weights, generation by generation
+	std::vector<double> weights;
+
+	//! Index of the parent in the previous generation
+	std::vector<int> parents;
+};
+
+#endif /* FIXEDLAGSMOOTHER_HPP_ */
@@ -0,0 +1,130 @@
+/**
+ * @brief Per-frame structures that are shared by all filters tracking in the same frame
+ * @file FrameFeatures.h
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+
+#ifndef FRAMEFEATURES_H_
+#define FRAMEFEATURES_H_
+
+#include <ColorSpace.h>
+#include <IntegralHistogram.h>
+#include <BackgroundModel.h>
+#include <CImg.h>
+
+#include <map>
+
+using namespace cimg_library;
+
+/* **************************************************************************************
+ * Interface of FrameFeatures
+ * **************************************************************************************/
+
+/**
+ * Everything that is calculated once per frame before the likelihoods of the particles: the
+ * conversion to another color space, the integral histograms (one per number of bins), and the
+ * background model. A filter tracking a single object owns one of these. Filters tracking several
+ * objects in the same frame share one (see MultiTargetTracker), so all of it is calculated only once
+ * however many objects there are.
+ *
+ * Users register what they need. An integral histogram is calculated as long as at least one user
+ * requires its number of bins, and likewise for the background model. After Update everything is
+ * read-only, so the likelihoods can be calculated concurrently.
+ */
+class FrameFeatures {
+public:
+	//! Constructor FrameFeatures
+	FrameFeatures();
+
+	//! Destructor ~FrameFeatures
+	virtual ~FrameFeatures();
+
+	/**
+	 * Convert the frame and calculate all integral histograms that are required, and update the
+	 * background model if it is required. The background model gets the original frame.
+	 */
+	void Update(CImg<DataValue> & frame);
+
+	//! Set the color space, this holds for all users
+	inline void setColorSpace(ColorSpace color_space) { converter.setColorSpace(color_space); }
+
+	//! Get the color space
+	inline ColorSpace getColorSpace() { return converter.getColorSpace(); }
+
+	//! The last frame (converted to the requested color space), NULL before the first Update
+	inline CImg<DataValue> * getImage() { return img; }
+
+	/**
+	 * Require an integral histogram with the given number of bins. It is calculated from the next Update
+	 * on, or immediately if there has been a frame already.
+	 * @return				the histogram, owned by this object and valid until it is released
+	 */
+	IntegralHistogram * Require(int bins);
+
+	//! Release an integral histogram, it is deleted when the last user releases it
+	void Release(int bins);
+
+	//! Require the background model, it is updated from the next Update on
+	void RequireBackground();
+
+	//! Release the background model
+	void ReleaseBackground();
+
+	//! Restart the background model with the next frame
+	inline void ResetBackground() { background.Reset(); }
+
+	//! The background model (only updated if it is required)
+	inline BackgroundModel & getBackgroundModel() { return background; }
+
+	//! The number of frames seen
+	inline long getFrameCount() { return frame_count; }
+
+private:
+	//! An integral histogram and its number of users
+	struct RequiredHistogram {
+		IntegralHistogram *histogram;
+		int users;
+	};
+
+	//! Color space conversion
+	ColorSpaceConverter converter;
+
+	//! The last converted frame
+	CImg<DataValue> *img;
+
+	//! Integral histograms by number of bins
+	std::map<int, RequiredHistogram> histograms;
+
+	//! Background model
+	BackgroundModel background;
+
+	//! Number of users of the background model
+	int background_users;
+
+	//! Number of frames seen
+	long frame_count;
+
+	//! Not copyable (owns the histograms)
+	FrameFeatures(const FrameFeatures &);
+	FrameFeatures & operator=(const FrameFeatures &);
+};
+
+#endif /* FRAMEFEATURES_H_ */
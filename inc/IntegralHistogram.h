@@ -0,0 +1,193 @@
+/**
+ * @brief Integral histogram over an entire frame
+ * @file IntegralHistogram.h
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+
+#ifndef INTEGRALHISTOGRAM_H_
+#define INTEGRALHISTOGRAM_H_
+
+#include <Histogram.h>
+#include <CImg.h>
+
+#include <vector>
+
+using namespace cimg_library;
+
+/**
+ * The weights for a kernel-weighted histogram over a region of a given size. The region is
+ * divided in "layers" nested rectangles, the outermost being the region itself. Each rectangle
+ * l is the region shrunk by offset_x[l] and offset_y[l] at every side. A pixel in ring l (inside
+ * rectangle l, but not in rectangle l-1) gets the average kernel weight of that ring. Written
+ * as a sum over the rectangles themselves, rectangle l is counted with weight coefficient[l].
+ */
+struct KernelTile {
+	std::vector<int> offset_x;
+	std::vector<int> offset_y;
+	std::vector<Value> coefficient;
+	//! Sum of all pixel weights, used for normalization
+	Value total;
+};
+
+//! Number of slots in the cache of kernel tiles
+#define KERNEL_TILE_SLOTS 64
+
+/**
+ * A slot in the cache of kernel tiles. The slot is claimed by the first query that needs it, which
+ * calculates the tile and only then marks it as ready, so other queries can read it without a lock.
+ */
+struct KernelTileSlot {
+	//! The key: region size and number of layers
+	int width, height, layers;
+	//! 0 if empty, 1 while the tile is calculated, 2 if ready
+	volatile int state;
+	//! Set if a query needed the slot for another key, the slot is freed at the next Update
+	volatile int conflict;
+	//! The tile itself
+	KernelTile tile;
+};
+
+/* **************************************************************************************
+ * Interface of IntegralHistogram
+ * **************************************************************************************/
+
+/**
+ * An integral histogram stores for every pixel (x,y) the histogram of the rectangle from the
+ * origin to (x,y). It is calculated once per frame, after which the histogram of any rectangle
+ * takes four lookups per bin, independent of the size of the rectangle. This replaces cropping
+ * the image and running a Histogram over it for every particle.
+ *
+ * Binning is the same as Histogram::value2bin: the range [0,255] uniformly divided over the bins.
+ * The bins are stored innermost, so the four lookups of a query are four contiguous runs.
+ *
+ * Rectangles are given by inclusive corner coordinates, like CImg::get_crop. Pixels outside of
+ * the frame are counted as zero-valued pixels (bin 0), again like get_crop.
+ *
+ * The queries do not change the object, so they can be run concurrently after Update. The only
+ * exception is the cache of kernel tiles, of which the slots are claimed with an atomic operation,
+ * so lookups do not take a lock. Update itself should not run concurrently with queries.
+ */
+class IntegralHistogram {
+public:
+	//! Constructor IntegralHistogram
+	IntegralHistogram(int bins = 16);
+
+	//! Destructor ~IntegralHistogram
+	virtual ~IntegralHistogram();
+
+	/**
+	 * Calculate bin plane and integral histogram for a frame. Memory is only reallocated if
+	 * the size of the frame changes.
+	 * @param frame			the (converted) image
+	 * @param channel		the channel to bin
+	 */
+	void Update(CImg<DataValue> & frame, int channel = 0);
+
+	//! Get number of bins
+	inline int getBins() { return bins; }
+
+	//! Width of the last frame
+	inline int getWidth() { return width; }
+
+	//! Height of the last frame
+	inline int getHeight() { return height; }
+
+	//! The bin index of every pixel of the last frame (row by row)
+	inline const DataValue * getBinPlane() { return bin_plane; }
+
+	/**
+	 * Get the frequencies in the rectangle [x0,x1]x[y0,y1]. Four lookups per bin.
+	 * @param result		array of size "bins" that will be overwritten
+	 * @return				number of pixels in the rectangle
+	 */
+	int getFrequencies(int x0, int y0, int x1, int y1, HistogramValue *result);
+
+	/**
+	 * Get the normalized histogram of the rectangle [x0,x1]x[y0,y1].
+	 */
+	void getProbabilities(int x0, int y0, int x1, int y1, NormalizedHistogramValues & result);
+
+	/**
+	 * Get the histograms of a grid of sub-rectangles of [x0,x1]x[y0,y1], for example to match a
+	 * head and a torso separately. The parts are stored row by row, each as "bins" normalized
+	 * values, so the result has columns*rows*bins elements.
+	 * @param columns		number of parts in horizontal direction
+	 * @param rows			number of parts in vertical direction
+	 */
+	void getPartProbabilities(int x0, int y0, int x1, int y1, int columns, int rows,
+			NormalizedHistogramValues & result);
+
+	/**
+	 * Get the kernel-weighted (Epanechnikov) normalized histogram of the rectangle [x0,x1]x[y0,y1].
+	 * The kernel is approximated by "layers" nested rectangles, so this takes "layers" times as
+	 * long as getProbabilities.
+	 */
+	void getKernelProbabilities(int x0, int y0, int x1, int y1, int layers,
+			NormalizedHistogramValues & result);
+
+	/**
+	 * Get the kernel weights for a region of a given size. Tiles are calculated once per region
+	 * size and number of layers and cached afterwards in a fixed number of slots. If the slot of
+	 * the size is taken by another size (or still being calculated), the tile is calculated in
+	 * the scratch tile instead, and the slot is freed at the next Update.
+	 * @param scratch		tile to use if the tile is not cached
+	 * @return				the cached tile or the scratch tile
+	 */
+	const KernelTile & getKernelTile(int region_width, int region_height, int layers, KernelTile & scratch);
+
+protected:
+	//! Calculate kernel tile from scratch
+	void calcKernelTile(int region_width, int region_height, int layers, KernelTile & tile);
+
+	//! Allocate memory for a frame of given size
+	void Allocate(int width, int height);
+
+	//! Deallocate all structures
+	void Clear();
+
+private:
+	//! Number of bins
+	int bins;
+
+	//! Width of the frame
+	int width;
+
+	//! Height of the frame
+	int height;
+
+	//! Bin index per pixel
+	DataValue *bin_plane;
+
+	//! Integral histogram of size (width+1)*(height+1)*bins
+	HistogramValue *integral;
+
+	//! Running histogram of the current row (used during Update)
+	std::vector<HistogramValue> row_sum;
+
+	//! Cached kernel tiles, direct-mapped on region size and layers
+	KernelTileSlot kernel_tiles[KERNEL_TILE_SLOTS];
+
+	//! Not copyable (owns the frame-sized arrays)
+	IntegralHistogram(const IntegralHistogram &);
+	IntegralHistogram & operator=(const IntegralHistogram &);
+};
+
+#endif /* INTEGRALHISTOGRAM_H_ */
@@ -0,0 +1,131 @@
+/**
+ * @brief Low-discrepancy sequences for quasi-Monte Carlo sampling
+ * @file LowDiscrepancy.hpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common 
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from 
+ * thread pools and TCP/IP components to control architectures and learning algorithms. 
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory 
+ * farming, for animal experimentation, or anything that violates the Universal 
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+
+#ifndef LOWDISCREPANCY_HPP_
+#define LOWDISCREPANCY_HPP_
+
+#include <vector>
+#include <cmath>
+#include <cassert>
+
+namespace dobots {
+
+/**
+ * The radical inverse of an index in a given base: the digits of the index in that base are mirrored
+ * around the decimal point. For base 2: 1 -> 0.5, 2 -> 0.25, 3 -> 0.75, 4 -> 0.125, etc. This is the
+ * van der Corput sequence, each dimension of a Halton sequence uses it with another prime as base.
+ * @param base				the base (a prime)
+ * @param index				the index in the sequence
+ * @return					a value in [0,1)
+ */
+template<typename T>
+T radical_inverse(int base, unsigned long index) {
+	T result = T(0);
+	T factor = T(1) / base;
+	T digit = factor;
+	while (index > 0) {
+		result += (index % base) * digit;
+		index /= base;
+		digit *= factor;
+	}
+	return result;
+}
+
+/**
+ * The inverse of the standard normal cumulative distribution function, with the rational approximation
+ * of Peter Acklam (relative error below 1.15e-9). Maps a uniform sample in (0,1) onto a standard normal
+ * sample, and keeps the spread of a low-discrepancy sequence.
+ * @param p					probability in (0,1), values at the boundaries are clamped
+ * @return					x for which Phi(x) = p
+ */
+template<typename T>
+T inverse_normal_cdf(T p) {
+	static const double a[] = { -3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02,
+			1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00 };
+	static const double b[] = { -5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02,
+			6.680131188771972e+01, -1.328068155288572e+01 };
+	static const double c[] = { -7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+			-2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00 };
+	static const double d[] = { 7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00,
+			3.754408661907416e+00 };
+	const double low = 0.02425, high = 1 - low;
+	double q = p;
+	if (q < 1e-12) q = 1e-12;
+	if (q > 1 - 1e-12) q = 1 - 1e-12;
+	if (q < low) {
+		double r = std::sqrt(-2 * std::log(q));
+		return T((((((c[0]*r+c[1])*r+c[2])*r+c[3])*r+c[4])*r+c[5]) / ((((d[0]*r+d[1])*r+d[2])*r+d[3])*r+1));
+	}
+	if (q > high) {
+		double r = std::sqrt(-2 * std::log(1 - q));
+		return T(-(((((c[0]*r+c[1])*r+c[2])*r+c[3])*r+c[4])*r+c[5]) / ((((d[0]*r+d[1])*r+d[2])*r+d[3])*r+1));
+	}
+	double r = (q - 0.5) * (q - 0.5);
+	return T((((((a[0]*r+a[1])*r+a[2])*r+a[3])*r+a[4])*r+a[5])*(q - 0.5) /
+			(((((b[0]*r+b[1])*r+b[2])*r+b[3])*r+b[4])*r+1));
+}
+
+/**
+ * A Halton sequence in a few dimensions, with a random shift per dimension (a Cranley-Patterson rotation)
+ * as scrambling. The first N points of the sequence cover the unit cube much more evenly than N random
+ * points, while a new shift makes every set of points an unbiased sample again (randomized quasi-Monte
+ * Carlo). There is no state except for the shifts, so a point can be requested by index.
+ */
+template<typename T>
+class HaltonSequence {
+public:
+	//! Constructor for a sequence with the given number of dimensions (at most 16)
+	HaltonSequence(int dimensions = 2): shift(dimensions, T(0)) {
+		assert (dimensions > 0 && dimensions <= 16);
+	}
+
+	//! Number of dimensions
+	inline int getDimensions() { return shift.size(); }
+
+	//! Set the shift of a dimension, a value in [0,1)
+	inline void setShift(int dimension, T value) { shift[dimension] = value; }
+
+	//! Get the coordinate of point "index" in the given dimension, a value in [0,1)
+	inline T get(unsigned long index, int dimension) {
+		static const int primes[] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53 };
+		T u = radical_inverse<T>(primes[dimension], index) + shift[dimension];
+		return u >= T(1) ? u - T(1) : u;
+	}
+
+	/**
+	 * Get the coordinate of point "index" in the given dimension as a standard normal sample. Note that
+	 * without a shift point 0 is the origin, which maps onto the (clamped) far tail, so start at index 1.
+	 */
+	inline T getNormal(unsigned long index, int dimension) {
+		return inverse_normal_cdf<T>(get(index, dimension));
+	}
+
+private:
+	//! Random shift per dimension
+	std::vector<T> shift;
+};
+
+}
+
+#endif /* LOWDISCREPANCY_HPP_ */
@@ -0,0 +1,140 @@
+/**
+ * @brief Monte Carlo localization of a robot with a range sensor in an occupancy grid map
+ * @file MonteCarloLocalization.h
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+
+#ifndef MONTECARLOLOCALIZATION_H_
+#define MONTECARLOLOCALIZATION_H_
+
+#include <FilterBank.hpp>
+#include <OccupancyGrid.h>
+
+#include <vector>
+
+//! Number of particles of which the beams are evaluated together
+#define SCAN_BLOCK 256
+
+/* **************************************************************************************
+ * Interface of MonteCarloLocalization
+ * **************************************************************************************/
+
+/**
+ * A robot that tracks its own pose (x, y, theta) in a known map, with odometry and a range sensor such as
+ * a laser scanner. The pose is the state of a FilterBank with a single filter: columns 0 and 1 are the
+ * position in world units, column 2 the heading in radians.
+ *
+ * The motion model is the odometry model: the displacement between two odometry readings is split in a
+ * rotation, a translation and a second rotation, each with noise that grows with the size of the motion.
+ * The observation model is the likelihood field of the OccupancyGrid: the end point of every beam is
+ * looked up in the precomputed field, and the log-likelihoods of the beams are summed. The beams are
+ * evaluated for a block of SCAN_BLOCK particles at a time, beam after beam, so the inner loop runs over
+ * the particles with the cosine and sine of their heading computed once per scan. Readings at the maximum
+ * range carry no information about obstacles and are skipped.
+ */
+class MonteCarloLocalization: public FilterBank<3, Value> {
+public:
+	/**
+	 * Constructor MonteCarloLocalization
+	 * @param map			the map, with the likelihood field calculated (see CalcLikelihoodField)
+	 * @param particles		the number of particles
+	 */
+	MonteCarloLocalization(OccupancyGrid & map, int particles);
+
+	//! Destructor ~MonteCarloLocalization
+	virtual ~MonteCarloLocalization();
+
+	/**
+	 * Set the noise of the odometry model. The standard deviation of a rotation is rotation * |rotation| +
+	 * translation_rotation * |translation|, and that of the translation is translation * |translation| +
+	 * rotation_translation * (|rotation 1| + |rotation 2|).
+	 */
+	inline void SetMotionNoise(Value rotation, Value translation, Value rotation_translation = 0.01,
+			Value translation_rotation = 0.01) {
+		noise_rotation = rotation;
+		noise_translation = translation;
+		noise_rotation_translation = rotation_translation;
+		noise_translation_rotation = translation_rotation;
+	}
+
+	/**
+	 * Set the geometry of the range sensor.
+	 * @param angles		the angle of every beam relative to the heading of the robot
+	 * @param beams			the number of beams
+	 * @param max_range		the maximum range, readings at or beyond it are skipped
+	 * @param step			use every step-th beam only
+	 */
+	void SetSensor(const Value *angles, int beams, Value max_range, int step = 1);
+
+	//! Spread the particles uniformly over the free cells of the map, with a uniform heading
+	void InitGlobal();
+
+	//! Spread the particles uniformly around a pose
+	void InitPose(Value x, Value y, Value theta, Value spread, Value spread_theta);
+
+	/**
+	 * Move the particles with the odometry and weigh them with a scan, then resample.
+	 * @param dx			displacement forward, in the frame of the previous pose
+	 * @param dy			displacement to the left, in the frame of the previous pose
+	 * @param dtheta		change of heading
+	 * @param ranges		the range of every beam
+	 */
+	void Update(Value dx, Value dy, Value dtheta, const Value *ranges);
+
+	/**
+	 * The mean pose of the particles, with the circular mean of the heading.
+	 */
+	void GetPose(Value & x, Value & y, Value & theta);
+
+protected:
+	//! The odometry model
+	void Transition(int begin, int end);
+
+	//! The summed log-likelihood of the beams, relative to the best particle of the filter
+	void Likelihood(int begin, int end);
+
+private:
+	//! The map with the likelihood field
+	OccupancyGrid & map;
+
+	//! Cosine and sine of the angle of the beams that are used
+	std::vector<Value> beam_cos, beam_sin;
+
+	//! Index of the beams that are used
+	std::vector<int> beam_index;
+
+	//! The last scan
+	std::vector<Value> ranges;
+
+	//! Maximum range of the sensor
+	Value max_range;
+
+	//! The odometry of the current update: rotation, translation, rotation
+	Value rotation1, translation, rotation2;
+
+	//! Noise of the odometry model
+	Value noise_rotation, noise_translation, noise_rotation_translation, noise_translation_rotation;
+
+	//! Summed log-likelihoods of all particles, the lowest Value for particles that are not in free space
+	std::vector<Value> log_likelihoods;
+};
+
+#endif /* MONTECARLOLOCALIZATION_H_ */
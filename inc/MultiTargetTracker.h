@@ -0,0 +1,230 @@
+/**
+ * @brief Tracking of many objects in the same frame with shared per-frame features
+ * @file MultiTargetTracker.h
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+
+#ifndef MULTITARGETTRACKER_H_
+#define MULTITARGETTRACKER_H_
+
+#include <PositionParticleFilter.h>
+#include <FrameFeatures.h>
+#include <WorkerPool.hpp>
+#include <CImg.h>
+
+#include <vector>
+
+using namespace cimg_library;
+
+//! Number of particles per piece of work in the batch of likelihoods
+#define LIKELIHOOD_GRAIN 64
+
+/* **************************************************************************************
+ * Interface of MultiTargetTracker
+ * **************************************************************************************/
+
+/**
+ * Tracks a number of objects in the same video, each with its own PositionParticleFilter. The filters
+ * share a single FrameFeatures, so the color conversion, the integral histograms and the background
+ * model are calculated once per frame instead of once per object. Filters that need the same number
+ * of bins (for example for a cascade stage) share the integral histogram as well.
+ *
+ * Per frame (and subtick) the filters are first all predicted, one after the other, because the
+ * motion models draw from a common random number generator. The likelihoods of all particles of all
+ * filters are then calculated as one batch, split in pieces of LIKELIHOOD_GRAIN particles, on the
+ * worker pool. Finally every filter corrects and resamples. The likelihood is by far the most
+ * expensive step, and a batch over all objects keeps all threads busy even if single objects have
+ * only a few particles.
+ *
+ * Independent filters tend to end up on the same object when two objects overlap, because both find
+ * their best match there. Two things help (both disabled by default):
+ *  - occlusion (see SetOcclusion): an object of which a large part of the predicted region is covered
+ *    by an object in front of it is marked occluded, and follows its motion model without looking at the
+ *    frame until it reappears;
+ *  - interaction (see SetInteraction): the targets form a Markov random field in which particles of one
+ *    target are penalized for being close to the particles of others, so the clouds repel each other.
+ */
+class MultiTargetTracker {
+public:
+	//! Constructor MultiTargetTracker
+	MultiTargetTracker();
+
+	//! Destructor ~MultiTargetTracker, deletes the filters
+	virtual ~MultiTargetTracker();
+
+	//! Use a pool of worker threads for the likelihoods (not owned), NULL to use the calling thread
+	inline void SetWorkerPool(WorkerPool *pool) { this->pool = pool; }
+
+	//! Set the color space for all filters
+	inline void SetColorSpace(ColorSpace color_space) { features.setColorSpace(color_space); }
+
+	//! The frame features that are shared by all filters
+	inline FrameFeatures & GetFrameFeatures() { return features; }
+
+	/**
+	 * Calculate the frame features, for example for the frame in which targets are added. Tick does this
+	 * itself.
+	 */
+	void SetFrame(CImg<DataValue> & frame);
+
+	/**
+	 * Add a target in the last frame (see SetFrame) with a default filter.
+	 * @param coord				CImg coordinates, careful: picks 0,1 3,4 (skips 2)
+	 * @param particle_count	the number of particles to be generated
+	 * @return					the index of the target
+	 */
+	int AddTarget(CImg<CoordValue> & coord, int particle_count);
+
+	/**
+	 * Add a target in the last frame (see SetFrame) with a filter that is configured by the caller, for
+	 * example with parts or a cascade. The tracker takes ownership of the filter and initializes it.
+	 * @return					the index of the target
+	 */
+	int AddTarget(PositionParticleFilter *filter, CImg<CoordValue> & coord, int particle_count);
+
+	//! Remove (and delete) a target, the indices of the targets after it shift down by one
+	void RemoveTarget(int index);
+
+	//! The number of targets
+	inline int GetTargets() { return filters.size(); }
+
+	//! The filter of a target
+	inline PositionParticleFilter & GetTarget(int index) { return *filters[index]; }
+
+	/**
+	 * Interaction between the targets: the weight of a particle is multiplied with exp(-strength * s), with
+	 * s the sum over the other targets of the fraction of their particles near the particle, each weighted
+	 * with the kernel max(0, 1 - d^2/r^2). The particles are kept in a grid with cells of r by r, with per
+	 * cell the number of particles and the sum of their positions, and a particle is compared with the
+	 * 3x3 cells around it (as if all particles of a cell were at their centroid). The cost is then linear
+	 * in the total number of particles instead of quadratic.
+	 * @param strength			strength of the repulsion, 0 (default) disables the interaction
+	 * @param radius			the radius r in pixels, 0 for the mean width of the targets
+	 */
+	inline void SetInteraction(Value strength, Value radius = 0) {
+		interaction_strength = strength;
+		interaction_radius = radius;
+	}
+
+	/**
+	 * Mark a target as occluded (see PositionParticleFilter::SetOccluded) if the fraction of its predicted
+	 * region covered by another target in front of it is at least the given fraction. Of two targets the one
+	 * with the lowest bottom edge in the frame is assumed to be in front, as for a camera looking down on a
+	 * field. The predicted regions are compared pairwise, which is fine for tens of targets.
+	 * @param overlap			minimum covered fraction, 0 (default) disables occlusion
+	 */
+	inline void SetOcclusion(Value overlap) { occlusion_overlap = overlap; }
+
+	/**
+	 * Track all targets in the next frame.
+	 * @param frame				the image with the targets
+	 * @param subticks			the number of times this same image is used (see PositionParticleFilter::Tick)
+	 */
+	void Tick(CImg<DataValue> *frame, int subticks = 1);
+
+protected:
+	//! Calculate the likelihoods of all particles of the active filters that are not occluded
+	void Likelihood();
+
+	//! Mark the active filters that are occluded (see SetOcclusion)
+	void Occlusion();
+
+	//! Multiply the weights of the particles of the targets with the interaction potential (see SetInteraction)
+	void Interact(std::vector<PositionParticleFilter*> & targets);
+
+private:
+	//! A range of particles of a single filter
+	struct LikelihoodJob {
+		PositionParticleFilter *filter;
+		int begin;
+		int end;
+	};
+
+	//! Runs the jobs of a batch
+	class LikelihoodBatch: public WorkerTask {
+	public:
+		LikelihoodBatch(std::vector<LikelihoodJob> & jobs): jobs(jobs) {}
+		void Run(int begin, int end) {
+			for (int j = begin; j < end; ++j) {
+				jobs[j].filter->BatchLikelihood(jobs[j].begin, jobs[j].end);
+			}
+		}
+	private:
+		std::vector<LikelihoodJob> & jobs;
+	};
+
+	//! Shared frame features
+	FrameFeatures features;
+
+	//! The last frame given to SetFrame or Tick
+	CImg<DataValue> *frame;
+
+	//! A filter per target
+	std::vector<PositionParticleFilter*> filters;
+
+	//! The filters that track the current frame with particles
+	std::vector<PositionParticleFilter*> active;
+
+	//! The batch of likelihoods, kept to not allocate every frame
+	std::vector<LikelihoodJob> jobs;
+
+	//! Worker threads (not owned)
+	WorkerPool *pool;
+
+	//! Strength of the repulsion between targets (0 for none)
+	Value interaction_strength;
+
+	//! Radius of the repulsion (0 for the mean width)
+	Value interaction_radius;
+
+	//! Covered fraction above which a target is occluded (0 for never)
+	Value occlusion_overlap;
+
+	//! The positions of the particles of all interacting targets, one target after the other
+	std::vector<Value> positions_x, positions_y;
+
+	//! Factors for the weights of a single target
+	std::vector<Value> factors;
+
+	//! Per grid cell the number of particles (as fraction of their target) and the sum of their positions
+	std::vector<Value> grid_mass, grid_x, grid_y;
+
+	//! The same for the particles of a single target
+	std::vector<Value> own_mass, own_x, own_y;
+
+	//! The start of the particles of every target in the positions, plus the end
+	std::vector<int> offsets;
+
+	//! The grid cell of every particle in the positions
+	std::vector<int> cell_of;
+
+	//! The cells that are used by a single target
+	std::vector<int> used;
+
+	//! The predicted regions of the active targets
+	std::vector<RegionEstimate> estimates;
+
+	//! Not copyable (owns the filters)
+	MultiTargetTracker(const MultiTargetTracker &);
+	MultiTargetTracker & operator=(const MultiTargetTracker &);
+};
+
+#endif /* MULTITARGETTRACKER_H_ */
@@ -0,0 +1,166 @@
+/**
+ * @brief Occupancy grid map with a precomputed likelihood field for range sensors
+ * @file OccupancyGrid.h
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+
+#ifndef OCCUPANCYGRID_H_
+#define OCCUPANCYGRID_H_
+
+#include <ProbMatrix.h>
+#include <CImg.h>
+
+#include <vector>
+#include <cmath>
+
+using namespace cimg_library;
+
+/**
+ * The state of a cell of an occupancy grid
+ */
+enum CellState {
+	CS_FREE,
+	CS_OCCUPIED,
+	CS_UNKNOWN,
+	CS_CELL_TYPES
+};
+
+/* **************************************************************************************
+ * Interface of OccupancyGrid
+ * **************************************************************************************/
+
+/**
+ * A map of the world as a grid of cells that are free, occupied or unknown, with its origin (the world
+ * coordinates of the corner of cell 0,0) and resolution (the size of a cell in world units, for example
+ * meters).
+ *
+ * For the likelihood of a range scan (see MonteCarloLocalization) the end point of every beam is looked
+ * up in a likelihood field: per cell the log of z_hit N(d; 0, sigma) + z_random / max_range, with d the
+ * distance to the nearest occupied cell. The distances come from an exact Euclidean distance transform
+ * (two passes of lower envelopes of parabolas, linear in the number of cells), so a beam costs a single
+ * lookup instead of ray casting. Outside the map only the random part remains.
+ */
+class OccupancyGrid {
+public:
+	/**
+	 * Constructor OccupancyGrid, all cells are free
+	 * @param width			number of cells in horizontal direction
+	 * @param height		number of cells in vertical direction
+	 * @param resolution	size of a cell in world units
+	 * @param origin_x		world coordinates of the corner of cell 0,0
+	 * @param origin_y
+	 */
+	OccupancyGrid(int width, int height, Value resolution = 1, Value origin_x = 0, Value origin_y = 0);
+
+	//! Destructor ~OccupancyGrid
+	virtual ~OccupancyGrid();
+
+	/**
+	 * Take the cells from an image with a pixel per cell: dark pixels (mean of the channels below the
+	 * threshold) are occupied, the others are free. The grid gets the size of the image.
+	 */
+	void Load(CImg<DataValue> & img, int threshold = 128);
+
+	//! Set the state of a cell
+	inline void setCell(int x, int y, CellState state) { cells[y * width + x] = state; }
+
+	//! Get the state of a cell
+	inline CellState getCell(int x, int y) { return (CellState)cells[y * width + x]; }
+
+	inline int getWidth() { return width; }
+
+	inline int getHeight() { return height; }
+
+	inline Value getResolution() { return resolution; }
+
+	inline Value getOriginX() { return origin_x; }
+
+	inline Value getOriginY() { return origin_y; }
+
+	/**
+	 * Calculate the distance transform and the likelihood field, after the cells are set.
+	 * @param sigma			standard deviation of the measurement noise, in world units
+	 * @param z_hit			weight of the measurement noise
+	 * @param z_random		weight of random measurements
+	 * @param max_range		maximum range of the sensor, in world units
+	 */
+	void CalcLikelihoodField(Value sigma, Value z_hit = 0.9, Value z_random = 0.1, Value max_range = 10);
+
+	//! The distance from the centre of a cell to the nearest occupied cell in world units (after CalcLikelihoodField)
+	inline Value getDistance(int x, int y) { return distances[y * width + x]; }
+
+	//! The log-likelihood of an end point at world coordinates (after CalcLikelihoodField)
+	inline Value getLogLikelihood(Value x, Value y) {
+		int cx = (int)std::floor((x - origin_x) * inv_resolution);
+		int cy = (int)std::floor((y - origin_y) * inv_resolution);
+		if (cx < 0 || cy < 0 || cx >= width || cy >= height) return outside;
+		return field[cy * width + cx];
+	}
+
+	//! Whether the cell at world coordinates is free (false outside of the map)
+	inline bool isFree(Value x, Value y) {
+		int cx = (int)std::floor((x - origin_x) * inv_resolution);
+		int cy = (int)std::floor((y - origin_y) * inv_resolution);
+		if (cx < 0 || cy < 0 || cx >= width || cy >= height) return false;
+		return cells[cy * width + cx] == CS_FREE;
+	}
+
+	//! The log-likelihood of end points outside of the map
+	inline Value getOutsideLogLikelihood() { return outside; }
+
+	//! The log-likelihood field, row by row (after CalcLikelihoodField)
+	inline const Value * getLogLikelihoods() { return &field[0]; }
+
+	//! The free cells, as indices y * width + x
+	void GetFreeCells(std::vector<int> & free);
+
+protected:
+	//! One dimensional squared distance transform of f (n values with the given stride) into d
+	void Transform(Value *f, int n, int stride, Value *d, int *v, Value *z);
+
+private:
+	int width;
+
+	int height;
+
+	Value resolution;
+
+	//! 1 / resolution
+	Value inv_resolution;
+
+	Value origin_x;
+
+	Value origin_y;
+
+	//! The state of every cell
+	std::vector<unsigned char> cells;
+
+	//! Distance to the nearest occupied cell in world units
+	std::vector<Value> distances;
+
+	//! Log-likelihood of an end point in every cell
+	std::vector<Value> field;
+
+	//! Log-likelihood outside of the map
+	Value outside;
+};
+
+#endif /* OCCUPANCYGRID_H_ */
@@ -0,0 +1,342 @@
+/**
+ * @brief Forward-filter backward-smoother over a complete recorded sequence
+ * @file OfflineSmoother.hpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+
+#ifndef OFFLINESMOOTHER_HPP_
+#define OFFLINESMOOTHER_HPP_
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* **************************************************************************************
+ * Interface of OfflineSmoother
+ * **************************************************************************************/
+
+/**
+ * Forward-filter backward-smoother (FFBS) for a complete sequence. The forward pass is the normal
+ * particle filter, which stores per frame for every particle a snapshot (a POD struct) and its
+ * normalized weight. The backward pass draws trajectories from the smoothing distribution, from the
+ * last frame to the first: given the state x[t+1] of a trajectory, its state at time t is particle i
+ * with probability proportional to
+ *   w[t]_i f(x[t+1] | x[t]_i)
+ * with f the transition density. Calculating this for all particles costs O(N) per trajectory and
+ * frame, so O(N^2) for N trajectories. Instead, a candidate i is drawn from w[t] (a binary search in
+ * the cumulative weights, which are calculated once per frame) and accepted with probability
+ * f(x[t+1] | x[t]_i) / sup f. This costs O(1) expected trials per trajectory when the kernel is not too
+ * narrow with respect to the spread of the particles. After max_trials rejections the exact O(N)
+ * distribution is used for that trajectory, so the result is exact either way.
+ *
+ * The kernel is a functor with "double operator()(const Snapshot & from, const Snapshot & to)" that
+ * returns f(to | from) / sup f, so a value in [0,1].
+ *
+ * The storage grows with the sequence. It is kept in memory up to memory_limit bytes, after which it
+ * is moved to a (deleted) temporary file that is mapped into memory, so the operating system can
+ * page it out. The storage is reused (not freed) by Clear.
+ */
+template <typename Snapshot>
+class OfflineSmoother {
+public:
+	//! What is stored per particle and frame
+	struct Entry {
+		Snapshot snapshot;
+		double weight;
+	};
+
+	//! Constructor OfflineSmoother, call Configure before use
+	OfflineSmoother(): particles(0), frames(0), capacity(0), memory_limit(0), data(NULL),
+		fd(-1), mapped_size(0), trajectories(0), trials(0), fallbacks(0) {}
+
+	//! Destructor ~OfflineSmoother
+	virtual ~OfflineSmoother() {
+		Release();
+	}
+
+	/**
+	 * Forget the sequence and set the number of particles per frame.
+	 * @param particles		number of particles per frame
+	 * @param memory_limit	storage above this number of bytes is memory-mapped from a file
+	 * @param path			directory for the file, the default is /tmp
+	 */
+	void Configure(int particles, size_t memory_limit = 64 << 20, const std::string & path = "/tmp") {
+		assert (particles > 0);
+		Release();
+		this->particles = particles;
+		this->memory_limit = memory_limit;
+		this->path = path;
+	}
+
+	//! Forget the sequence, keep the storage
+	inline void Clear() { frames = 0; trajectories = 0; }
+
+	//! The number of particles per frame
+	inline int getParticles() { return particles; }
+
+	//! The number of frames stored
+	inline int getFrames() { return frames; }
+
+	//! True if the storage is memory-mapped from a file
+	inline bool isMapped() { return fd >= 0; }
+
+	//! The number of bytes reserved for the snapshots
+	inline size_t getMemoryFootprint() { return (size_t)capacity * particles * sizeof(Entry); }
+
+	/**
+	 * Start a new frame at the end of the sequence. Fill it with Set for all particles.
+	 * @return				false if storage could not be reserved
+	 */
+	bool Next() {
+		assert (particles > 0);
+		if (!Reserve(frames + 1)) return false;
+		frames++;
+		return true;
+	}
+
+	//! Set a particle in the last frame, the weights should be normalized
+	inline void Set(int particle, const Snapshot & snapshot, double weight) {
+		assert (frames > 0 && particle >= 0 && particle < particles);
+		Entry & e = data[(size_t)(frames - 1) * particles + particle];
+		e.snapshot = snapshot;
+		e.weight = weight;
+	}
+
+	//! Get the snapshot of a particle in a frame
+	inline const Snapshot & getSnapshot(int frame, int particle) {
+		assert (frame >= 0 && frame < frames);
+		return data[(size_t)frame * particles + particle].snapshot;
+	}
+
+	//! Get the (filter) weight of a particle in a frame
+	inline double getWeight(int frame, int particle) {
+		assert (frame >= 0 && frame < frames);
+		return data[(size_t)frame * particles + particle].weight;
+	}
+
+	/**
+	 * The backward pass, draw trajectories from the smoothing distribution over all frames stored.
+	 * @param trajectories	number of trajectories to draw
+	 * @param kernel		transition density divided by its supremum
+	 * @param max_trials	number of rejections before the exact distribution is used
+	 */
+	template <typename Kernel>
+	void Smooth(int trajectories, Kernel & kernel, int max_trials = 32) {
+		assert (trajectories > 0);
+		this->trajectories = trajectories;
+		indices.resize((size_t)trajectories * frames);
+		trials = fallbacks = 0;
+		if (frames == 0) return;
+		cumulative.resize(particles);
+		exact.resize(particles);
+
+		int t = frames - 1;
+		Accumulate(t);
+		for (int j = 0; j < trajectories; ++j) {
+			indices[(size_t)t * trajectories + j] = Draw(cumulative);
+		}
+		for (t = frames - 2; t >= 0; --t) {
+			Accumulate(t);
+			const Entry *frame = data + (size_t)t * particles;
+			const Entry *next = data + (size_t)(t + 1) * particles;
+			for (int j = 0; j < trajectories; ++j) {
+				const Snapshot & target = next[indices[(size_t)(t + 1) * trajectories + j]].snapshot;
+				int index = -1;
+				for (int k = 0; k < max_trials; ++k) {
+					int i = Draw(cumulative);
+					trials++;
+					if (drand48() < kernel(frame[i].snapshot, target)) {
+						index = i;
+						break;
+					}
+				}
+				if (index < 0) {
+					// the exact backward kernel, if it vanishes everywhere fall back to the filter weights
+					fallbacks++;
+					double sum = 0;
+					for (int i = 0; i < particles; ++i) {
+						sum += frame[i].weight * kernel(frame[i].snapshot, target);
+						exact[i] = sum;
+					}
+					index = (sum > 0) ? Draw(exact) : Draw(cumulative);
+				}
+				indices[(size_t)t * trajectories + j] = index;
+			}
+		}
+	}
+
+	//! The number of trajectories of the last backward pass
+	inline int getTrajectories() { return trajectories; }
+
+	//! The index of the particle of a trajectory in a frame (after Smooth)
+	inline int getIndex(int trajectory, int frame) {
+		assert (trajectory >= 0 && trajectory < trajectories);
+		return indices[(size_t)frame * trajectories + trajectory];
+	}
+
+	//! The snapshot of a trajectory in a frame (after Smooth)
+	inline const Snapshot & getSmoothed(int trajectory, int frame) {
+		return getSnapshot(frame, getIndex(trajectory, frame));
+	}
+
+	//! The number of candidates drawn in the last backward pass
+	inline long getTrials() { return trials; }
+
+	//! The number of times the exact distribution was used in the last backward pass
+	inline long getFallbacks() { return fallbacks; }
+
+protected:
+	//! Cumulative weights of a frame
+	void Accumulate(int frame) {
+		const Entry *e = data + (size_t)frame * particles;
+		double sum = 0;
+		for (int i = 0; i < particles; ++i) {
+			sum += e[i].weight;
+			cumulative[i] = sum;
+		}
+	}
+
+	//! Draw an index from cumulative weights (binary search)
+	inline int Draw(const std::vector<double> & sums) {
+		double u = drand48() * sums.back();
+		int i = std::upper_bound(sums.begin(), sums.end(), u) - sums.begin();
+		return std::min(i, particles - 1);
+	}
+
+	/**
+	 * Make room for at least the given number of frames. The capacity doubles, so appending a frame
+	 * takes amortized constant time.
+	 */
+	bool Reserve(int required) {
+		if (required <= capacity) return true;
+		int new_capacity = std::max(required, std::max(capacity * 2, 16));
+		size_t bytes = (size_t)new_capacity * particles * sizeof(Entry);
+		if (fd < 0 && bytes <= memory_limit) {
+			memory.resize((size_t)new_capacity * particles);
+			data = &memory[0];
+			capacity = new_capacity;
+			return true;
+		}
+		if (fd < 0) {
+			std::string name = path + "/smootherXXXXXX";
+			std::vector<char> buffer(name.begin(), name.end());
+			buffer.push_back('\0');
+			fd = mkstemp(&buffer[0]);
+			if (fd < 0) {
+				std::cerr << "Could not create " << name << std::endl;
+				return false;
+			}
+			// the file disappears as soon as it is closed
+			unlink(&buffer[0]);
+		}
+		if (ftruncate(fd, bytes) != 0) {
+			std::cerr << "Could not grow smoother storage to " << bytes << " bytes" << std::endl;
+			return false;
+		}
+		if (mapped_size) munmap(data, mapped_size);
+		void *region = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (region == MAP_FAILED) {
+			std::cerr << "Could not map smoother storage" << std::endl;
+			data = NULL;
+			mapped_size = 0;
+			capacity = 0;
+			frames = 0;
+			return false;
+		}
+		data = static_cast<Entry*>(region);
+		mapped_size = bytes;
+		if (!memory.empty()) {
+			// move the frames so far from memory to the file
+			std::memcpy(data, &memory[0], (size_t)frames * particles * sizeof(Entry));
+			std::vector<Entry>().swap(memory);
+		}
+		capacity = new_capacity;
+		return true;
+	}
+
+	//! Free the storage, in memory or mapped
+	void Release() {
+		if (mapped_size) munmap(data, mapped_size);
+		if (fd >= 0) close(fd);
+		fd = -1;
+		mapped_size = 0;
+		std::vector<Entry>().swap(memory);
+		data = NULL;
+		capacity = frames = trajectories = 0;
+	}
+
+private:
+	//! Number of particles per frame
+	int particles;
+
+	//! Number of frames stored
+	int frames;
+
+	//! Number of frames there is room for
+	int capacity;
+
+	//! Maximum number of bytes in memory, above this the storage is mapped from a file
+	size_t memory_limit;
+
+	//! Directory of the file
+	std::string path;
+
+	//! The entries, frame by frame, either in memory or mapped
+	Entry *data;
+
+	//! Storage if it is kept in memory
+	std::vector<Entry> memory;
+
+	//! File descriptor of the mapped storage (-1 if in memory)
+	int fd;
+
+	//! Number of bytes mapped
+	size_t mapped_size;
+
+	//! Number of trajectories drawn in the backward pass
+	int trajectories;
+
+	//! Particle index per frame and trajectory
+	std::vector<int> indices;
+
+	//! Cumulative weights of the current frame
+	std::vector<double> cumulative;
+
+	//! Cumulative exact backward weights
+	std::vector<double> exact;
+
+	//! Statistics of the backward pass
+	long trials, fallbacks;
+
+	//! Not copyable (owns the storage)
+	OfflineSmoother(const OfflineSmoother &);
+	OfflineSmoother & operator=(const OfflineSmoother &);
+};
+
+#endif /* OFFLINESMOOTHER_HPP_ */
@@ -33,6 +33,9 @@
 #include <numeric>
 #include <cassert>
 #include <cmath>
+#include <limits>
+
+#include <WorkerPool.hpp>
 
 /* **************************************************************************************
  * Interface of ParticleFilter
@@ -82,11 +85,13 @@ public:
 	Particle() {
 		state = new State();
 		weight = 0;
+		ancestor = -1;
 	}
 
 	Particle(State *state, double weight) {
 		this->state = state;
 		this->weight = weight;
+		ancestor = -1;
 	}
 
 	~Particle() {
@@ -102,6 +107,11 @@ public:
 
 	inline void setWeight(double weight) { this->weight = weight; }
 
+	//! Index of the particle in the previous (recorded) generation this one descends from, -1 if unknown
+	inline int getAncestor() { return ancestor; }
+
+	inline void setAncestor(int ancestor) { this->ancestor = ancestor; }
+
 	/**
 	 * The clone function should not be really necessary, by implementing an assignment operator, a
 	 * copy constructor, and a swap function. However, I couldn't get it made to work.
@@ -109,6 +119,7 @@ public:
 	Particle *clone() {
 		State *s = new State(*state);
 		Particle *p = new Particle(s, 0);
+		p->ancestor = ancestor;
 		return p;
 	}
 
@@ -128,6 +139,7 @@ public:
 private:
 	State *state;
 	double weight;
+	int ancestor;
 
 	friend std::ostream& operator<<(std::ostream& os, const Particle & p) {
 		os << p.weight << ',' << p->state;
@@ -151,6 +163,20 @@ bool comp_particles(Particle<State> * p0, Particle<State> * p1) {
 	return (p0->getWeight() > p1->getWeight());
 }
 
+/**
+ * Helper class for sorting indices of particles (with highest weight first)
+ */
+template <typename State>
+class comp_particle_index {
+public:
+	comp_particle_index(std::vector<Particle<State>* > & particles): particles(particles) {}
+	bool operator()(int i, int j) const {
+		return (particles[i]->getWeight() > particles[j]->getWeight());
+	}
+private:
+	std::vector<Particle<State>* > & particles;
+};
+
 /**
  * Helper function for summing up and normalizing
  */
@@ -176,6 +202,47 @@ private:
 template <typename State>
 class ParticleFilter;
 
+//! Number of particles per chunk of the parallel resampler, fixed so the result does not depend on the number of threads
+#define RESAMPLE_CHUNK 4096
+
+//! Number of particles per chunk of the batch likelihood, small because a likelihood can be expensive
+#define LIKELIHOOD_CHUNK 256
+
+//! Maximum number of state columns of which the mean and covariance can be estimated
+#define MAX_ESTIMATE_COLUMNS 4
+
+/**
+ * The weighted mean and covariance of a few numeric columns of the state, see ParticleFilter::Estimate.
+ * Plain data, so it can be copied around freely.
+ */
+struct ParticleEstimate {
+	//! Number of columns
+	int columns;
+	//! Sum of the weights before normalization
+	double total;
+	//! Effective sample size 1/sum(w^2) of the normalized weights, as fraction of the number of particles
+	double ess;
+	//! Weighted mean of every column
+	double mean[MAX_ESTIMATE_COLUMNS];
+	//! Weighted covariance between the columns
+	double covariance[MAX_ESTIMATE_COLUMNS][MAX_ESTIMATE_COLUMNS];
+	//! Square root of the trace of the covariance
+	double spread;
+};
+
+/**
+ * Partial sums over a chunk of particles, of the weights and of the columns relative to a common shift (the
+ * columns of the first particle), which avoids cancellation in the covariance.
+ */
+struct EstimateMoments {
+	double sum;
+	double sum_squared;
+	double first[MAX_ESTIMATE_COLUMNS];
+	double second[MAX_ESTIMATE_COLUMNS][MAX_ESTIMATE_COLUMNS];
+	//! Index of the particle with the highest weight in the chunk
+	int best;
+};
+
 /**
  * Add particles to a set, and get them out.
  */
@@ -257,58 +324,517 @@ template <typename State>
 class ParticleFilter {
 public:
 	//! Constructor ParticleFilter
-	ParticleFilter() {}
+	ParticleFilter(): pool(NULL) {
+		last_estimate.columns = 0;
+		last_estimate.total = 0;
+	}
 
 	//! Destructor ~ParticleFilter
 	virtual ~ParticleFilter() {}
 
-	//! The actual smart part of the particle filter
+	/**
+	 * The actual smart part of the particle filter. Particles are copied round(w*N) times, in order of
+	 * their weight, and the particle with the highest weight fills up the rest. The copies of the
+	 * particle with the highest weight come first. The indices are sorted instead of the particles, so
+	 * every copy can refer to its ancestor by its index at the moment of Record(). The old particles
+	 * are deleted. The weights are normalized by Estimate, so GetEstimate afterwards gives the estimate
+	 * of the weighted particles.
+	 */
 	void Resample() {
-		set.Normalize();
-		// sort, with highest weight first
-		std::sort(set.particles.begin(), set.particles.end(), comp_particles<State>);
-		// now we append
-		int N = set.particles.size(); int newN = 0;
-		for (int i = 0; i < N; ++i) {
-			int copies = round(set.particles[i]->getWeight() * N);
-			for (int j = 0; j < copies; ++j) {
-				Particle<State> *newp = set.particles[i]->clone();
-				set.particles.push_back(newp);
-				newN++;
-				if (newN == N) {
-					// now remove old items
-					set.particles.erase(set.particles.begin(), set.particles.begin()+N);
-					assert ( set.particles.size() == newN);
-					return;
-				}
+		Estimate(last_estimate);
+		bool generation = Record();
+		int N = set.particles.size();
+		std::vector<int> order(N);
+		for (int i = 0; i < N; ++i) order[i] = i;
+		std::sort(order.begin(), order.end(), comp_particle_index<State>(set.particles));
+		std::vector<Particle<State>* > resampled;
+		resampled.reserve(N);
+		for (int i = 0; i < N && (int)resampled.size() < N; ++i) {
+			int copies = round(set.particles[order[i]]->getWeight() * N);
+			for (int j = 0; j < copies && (int)resampled.size() < N; ++j) {
+				resampled.push_back(Clone(order[i], generation));
 			}
 		}
-		while (newN < N) {
+		while ((int)resampled.size() < N) {
 			// duplicate particle with highest weight to get exactly same number again
-			Particle<State> *newp = set.particles[0]->clone();
-			set.particles.push_back(newp);
-			newN++;
+			resampled.push_back(Clone(order[0], generation));
+		}
+		for (int i = 0; i < N; ++i) {
+			delete set.particles[i];
 		}
-		set.particles.erase(set.particles.begin(), set.particles.begin()+N);
-		assert ( set.particles.size() == newN);
+		set.particles.swap(resampled);
 	}
 
+	/**
+	 * Systematic resampling: one offset u in [0,1) defines N equally spaced points (u+i)/N on the
+	 * cumulative weights, and every point selects the particle it falls in. This costs a single random
+	 * number per step (or a point of a low-discrepancy sequence), has a lower variance than drawing
+	 * N independent samples, and never duplicates a particle more than floor(w*N)+1 times. The weights
+	 * are accumulated in sorted order, so like with Resample() the copies of the particle with the
+	 * highest weight come first. The old particles are deleted.
+	 * @param offset		the offset u in [0,1)
+	 */
+	void Resample(double offset) {
+		assert (offset >= 0 && offset < 1);
+		Estimate(last_estimate);
+		bool generation = Record();
+		int N = set.particles.size();
+		if (!N) return;
+		std::vector<int> order(N);
+		for (int i = 0; i < N; ++i) order[i] = i;
+		std::sort(order.begin(), order.end(), comp_particle_index<State>(set.particles));
+		std::vector<Particle<State>* > resampled;
+		resampled.reserve(N);
+		double cumulative = set.particles[order[0]]->getWeight();
+		int j = 0;
+		for (int i = 0; i < N; ++i) {
+			double u = (i + offset) / N;
+			while (u > cumulative && j < N - 1) {
+				cumulative += set.particles[order[++j]]->getWeight();
+			}
+			resampled.push_back(Clone(order[j], generation));
+		}
+		for (int i = 0; i < N; ++i) {
+			delete set.particles[i];
+		}
+		set.particles.swap(resampled);
+	}
+
+	/**
+	 * Systematic resampling for large numbers of particles, on the worker pool (see SetWorkerPool). The
+	 * particles are split in fixed chunks of RESAMPLE_CHUNK. The sums of the chunks are calculated in
+	 * parallel (by Estimate) and only the prefix sum over the chunks is serial. Every chunk then covers a
+	 * contiguous range of the points (u+i)/N, which follows from its offset in the cumulative weights, and
+	 * draws those in parallel. Because the chunks do not depend on the number of threads, the result is the
+	 * same with any pool, or without one. Unlike Resample(double) the particles are not sorted, only
+	 * a copy of the particle with the highest weight is moved to the front. If the weights sum to zero,
+	 * they are all set to 1/N, so every particle is kept once.
+	 * @param offset		the offset u in [0,1)
+	 */
+	void ResampleParallel(double offset) {
+		assert (offset >= 0 && offset < 1);
+		int N = set.particles.size();
+		if (!N) return;
+		if (!Estimate(last_estimate)) {
+			for (int i = 0; i < N; ++i) set.particles[i]->setWeight(1.0 / N);
+			Estimate(last_estimate);
+		}
+		int chunks = chunk_moments.size();
+		ParallelResampler resampler(*this, offset);
+		resampler.first_point.resize(chunks + 1);
+		resampler.chunk_offset.resize(chunks);
+		resampler.resampled.resize(N);
+		resampler.best_copy = -1;
+
+		double total = last_estimate.total;
+		int best = chunk_moments[0].best;
+		for (int c = 1; c < chunks; ++c) {
+			if (set.particles[chunk_moments[c].best]->getWeight() > set.particles[best]->getWeight()) {
+				best = chunk_moments[c].best;
+			}
+		}
+		resampler.best = best;
+
+		// the points in chunk c are those with (i+u)/N in [offset of c, offset of c+1)
+		double cumulative = 0;
+		for (int c = 0; c < chunks; ++c) {
+			resampler.chunk_offset[c] = cumulative / total;
+			resampler.first_point[c] = (c == 0) ? 0 : std::min(N, std::max(resampler.first_point[c-1],
+					(int)std::ceil(resampler.chunk_offset[c] * N - offset)));
+			cumulative += chunk_moments[c].sum;
+		}
+		resampler.first_point[chunks] = N;
+
+		resampler.generation = Record();
+
+		resampler.phase = ParallelResampler::RP_DRAW;
+		RunChunks(resampler, chunks);
+		resampler.phase = ParallelResampler::RP_DELETE;
+		RunChunks(resampler, chunks);
+		set.particles.swap(resampler.resampled);
+		if (resampler.best_copy > 0) {
+			std::swap(set.particles[0], set.particles[resampler.best_copy]);
+		}
+	}
+
+	/**
+	 * Normalize the weights and calculate the weighted mean and covariance of the columns of the state
+	 * (see GetColumns), all in the same pass over the particles. The pass is split in chunks of
+	 * RESAMPLE_CHUNK particles, which run on the worker pool if there is one. The partial sums of the
+	 * chunks are combined in order, so the result does not depend on the number of threads. The
+	 * weights are left alone if they sum to zero.
+	 * @param estimate		the result
+	 * @return				false if there are no particles or the weights sum to zero
+	 */
+	bool Estimate(ParticleEstimate & estimate) {
+		int N = set.particles.size();
+		int columns = std::min(EstimateColumns(), MAX_ESTIMATE_COLUMNS);
+		estimate.columns = columns;
+		estimate.total = 0;
+		estimate.ess = 0;
+		estimate.spread = 0;
+		std::fill_n(estimate.mean, MAX_ESTIMATE_COLUMNS, 0.0);
+		std::fill_n(&estimate.covariance[0][0], MAX_ESTIMATE_COLUMNS * MAX_ESTIMATE_COLUMNS, 0.0);
+		if (!N) return false;
+
+		int chunks = (N + RESAMPLE_CHUNK - 1) / RESAMPLE_CHUNK;
+		chunk_moments.resize(chunks);
+		ParallelEstimator estimator(*this, columns);
+		if (columns) GetColumns(*set.particles[0]->getState(), estimator.shift);
+		estimator.phase = ParallelEstimator::EP_SUM;
+		RunChunks(estimator, chunks);
+
+		EstimateMoments sum;
+		ParallelEstimator::Reset(sum);
+		for (int c = 0; c < chunks; ++c) {
+			EstimateMoments & m = chunk_moments[c];
+			sum.sum += m.sum;
+			sum.sum_squared += m.sum_squared;
+			for (int i = 0; i < columns; ++i) {
+				sum.first[i] += m.first[i];
+				for (int j = 0; j <= i; ++j) sum.second[i][j] += m.second[i][j];
+			}
+		}
+		estimate.total = sum.sum;
+		if (sum.sum <= 0) return false;
+
+		estimate.ess = sum.sum * sum.sum / sum.sum_squared / N;
+		for (int i = 0; i < columns; ++i) {
+			double d = sum.first[i] / sum.sum;
+			estimate.mean[i] = estimator.shift[i] + d;
+			for (int j = 0; j <= i; ++j) {
+				double c = sum.second[i][j] / sum.sum - d * sum.first[j] / sum.sum;
+				estimate.covariance[i][j] = estimate.covariance[j][i] = c;
+			}
+			estimate.spread += std::max(estimate.covariance[i][i], 0.0);
+		}
+		estimate.spread = std::sqrt(estimate.spread);
+
+		estimator.total = sum.sum;
+		estimator.phase = ParallelEstimator::EP_NORMALIZE;
+		RunChunks(estimator, chunks);
+		return true;
+	}
+
+	//! The estimate of the last resampling step, calculated from the weights before resampling
+	inline const ParticleEstimate & GetEstimate() { return last_estimate; }
+
+	/**
+	 * Use a pool of worker threads for the parallel parts of the filter, such as ResampleParallel. The
+	 * pool is not owned by the filter and can be shared between filters. Use NULL (default) to run
+	 * everything in the calling thread.
+	 */
+	inline void SetWorkerPool(WorkerPool *pool) { this->pool = pool; }
+
+	//! Get the worker pool (can be NULL)
+	inline WorkerPool * GetWorkerPool() { return pool; }
+
+	//! The number of particles
+	inline int GetParticleCount() { return set.particles.size(); }
+
 	//! Transition according to a certain model
 	virtual void Transition() = 0;
 
 	//! Observation model:
 	//! - given a particle, how likely that it is corresponding to the tracked entity?
-	//! This function should calculate this for all particles and update weights accordingly
-	virtual void Likelihood() = 0;
+	//! This function should calculate this for all particles and update weights accordingly. By
+	//! default it calls BatchLikelihood, so a subclass only has to implement LogLikelihood.
+	virtual void Likelihood() { BatchLikelihood(); }
+
+	/**
+	 * Weigh all particles with LogLikelihood. The particles are split in chunks of LIKELIHOOD_CHUNK, which
+	 * run on the worker pool if there is one. Every chunk gets its states as a contiguous array and writes
+	 * the log-likelihoods to a contiguous array. The weights are then exp(l - max l), so the best particle
+	 * gets weight 1 and likelihoods that are far too small for a double are still compared correctly. The
+	 * maximum is taken over the chunks in order, so the result does not depend on the number of threads.
+	 * If no particle has a finite log-likelihood all weights are zero.
+	 */
+	void BatchLikelihood() {
+		int N = set.particles.size();
+		if (!N) return;
+		int chunks = (N + LIKELIHOOD_CHUNK - 1) / LIKELIHOOD_CHUNK;
+		batch_states.resize(N);
+		batch_log_weights.resize(N);
+		chunk_max.resize(chunks);
+		ParallelLikelihood evaluator(*this);
+		RunChunks(evaluator, chunks);
+		double max = -std::numeric_limits<double>::infinity();
+		for (int c = 0; c < chunks; ++c) {
+			max = std::max(max, chunk_max[c]);
+		}
+		evaluator.phase = ParallelLikelihood::LP_WEIGH;
+		evaluator.max = max;
+		RunChunks(evaluator, chunks);
+	}
+
+	/**
+	 * Start to weigh the particles with LogLikelihood in ranges, for a caller that evaluates the ranges of
+	 * several filters on a pool of its own (see MultiTargetTracker). Call BatchLikelihood(begin,end) for
+	 * the ranges, concurrently if need be, and EndBatchLikelihood after all of them. The weights are the
+	 * same as those of BatchLikelihood().
+	 */
+	void BeginBatchLikelihood() {
+		int N = set.particles.size();
+		batch_states.resize(N);
+		batch_log_weights.resize(N);
+		for (int i = 0; i < N; ++i) {
+			batch_states[i] = set.particles[i]->getState();
+		}
+	}
+
+	//! The log-likelihoods of the particles [begin,end), ranges can be evaluated concurrently
+	void BatchLikelihood(int begin, int end) {
+		if (begin >= end) return;
+		LogLikelihood(&batch_states[begin], end - begin, &batch_log_weights[begin]);
+	}
+
+	//! Set the weights to exp(l - max l) over the ranges evaluated since BeginBatchLikelihood
+	void EndBatchLikelihood() {
+		int N = set.particles.size();
+		double max = -std::numeric_limits<double>::infinity();
+		for (int i = 0; i < N; ++i) {
+			if (batch_log_weights[i] > max) max = batch_log_weights[i];
+		}
+		Weigh(0, N, max);
+	}
 
 protected:
 	//! Hand over access to particles to subclasses
 	std::vector<Particle<State>* >& getParticles() { return set.particles; }
 
+	/**
+	 * Hook at the start of resampling, when the weights are normalized and the particles are still in
+	 * their order, for example to store the generation for smoothing. If it returns true the copies
+	 * refer to the index of their ancestor in this order. If it returns false (a resampling step that
+	 * is not a generation of its own, such as the first stage of an auxiliary particle filter) the
+	 * copies keep the ancestor of the particle they are copied from.
+	 */
+	virtual bool Record() { return true; }
+
+	//! The number of numeric columns of the state that are estimated by Estimate (at most MAX_ESTIMATE_COLUMNS)
+	virtual int EstimateColumns() { return 0; }
+
+	//! Get the numeric columns of a state, this is called concurrently if there is a worker pool
+	virtual void GetColumns(State & /*state*/, double * /*values*/) {}
+
+	/**
+	 * The observation model for a batch of particles, see BatchLikelihood. This is called concurrently
+	 * for different batches if there is a worker pool. The default gives all particles the same weight.
+	 * @param states		the states of the particles in the batch
+	 * @param count			the number of particles in the batch
+	 * @param log_weights	the log-likelihood of every particle, to be written
+	 */
+	virtual void LogLikelihood(State * const * /*states*/, int count, double *log_weights) {
+		std::fill_n(log_weights, count, 0.0);
+	}
+
+	//! Copy a particle, and set its ancestor if this is a new generation
+	Particle<State> *Clone(int index, bool generation) {
+		Particle<State> *p = set.particles[index]->clone();
+		if (generation) p->setAncestor(index);
+		return p;
+	}
+
 private:
+	/**
+	 * The phases of ResampleParallel, each run over the chunks. The chunks are independent within a
+	 * phase: every chunk only writes its own entries.
+	 */
+	class ParallelResampler: public WorkerTask {
+	public:
+		enum Phase { RP_DRAW, RP_DELETE };
+
+		ParallelResampler(ParticleFilter & filter, double offset): filter(filter), offset(offset),
+				phase(RP_DRAW), best(0), best_copy(-1), generation(true) {}
+
+		void Run(int begin, int end) {
+			for (int c = begin; c < end; ++c) Chunk(c);
+		}
+
+		void Chunk(int c) {
+			std::vector<Particle<State>* > & particles = filter.set.particles;
+			int N = particles.size();
+			int p0 = c * RESAMPLE_CHUNK, p1 = std::min(N, p0 + RESAMPLE_CHUNK);
+			switch (phase) {
+			case RP_DRAW: {
+				double cumulative = chunk_offset[c] + particles[p0]->getWeight();
+				int j = p0;
+				for (int k = first_point[c]; k < first_point[c+1]; ++k) {
+					double u = (k + offset) / N;
+					while (u > cumulative && j < p1 - 1) {
+						cumulative += particles[++j]->getWeight();
+					}
+					resampled[k] = filter.Clone(j, generation);
+					if (j == best && (best_copy < 0 || k < best_copy)) best_copy = k;
+				}
+				break;
+			}
+			case RP_DELETE:
+				for (int i = p0; i < p1; ++i) {
+					delete particles[i];
+				}
+				break;
+			}
+		}
+
+		ParticleFilter & filter;
+		double offset;
+		Phase phase;
+		//! Start of every chunk in the normalized cumulative weights
+		std::vector<double> chunk_offset;
+		//! First point drawn by every chunk, plus N at the end
+		std::vector<int> first_point;
+		std::vector<Particle<State>* > resampled;
+		//! The particle with the highest weight and its first copy (only written by its own chunk)
+		int best, best_copy;
+		bool generation;
+	};
+
+	/**
+	 * The phases of Estimate: the partial sums per chunk, and the normalization of the weights. The inner
+	 * loops run over a fixed, small number of columns.
+	 */
+	class ParallelEstimator: public WorkerTask {
+	public:
+		enum Phase { EP_SUM, EP_NORMALIZE };
+
+		ParallelEstimator(ParticleFilter & filter, int columns): filter(filter), columns(columns),
+				phase(EP_SUM), total(1) {
+			std::fill_n(shift, MAX_ESTIMATE_COLUMNS, 0.0);
+		}
+
+		static void Reset(EstimateMoments & m) {
+			m.sum = m.sum_squared = 0;
+			std::fill_n(m.first, MAX_ESTIMATE_COLUMNS, 0.0);
+			std::fill_n(&m.second[0][0], MAX_ESTIMATE_COLUMNS * MAX_ESTIMATE_COLUMNS, 0.0);
+			m.best = 0;
+		}
+
+		void Run(int begin, int end) {
+			for (int c = begin; c < end; ++c) Chunk(c);
+		}
+
+		void Chunk(int c) {
+			std::vector<Particle<State>* > & particles = filter.set.particles;
+			int N = particles.size();
+			int p0 = c * RESAMPLE_CHUNK, p1 = std::min(N, p0 + RESAMPLE_CHUNK);
+			if (phase == EP_NORMALIZE) {
+				for (int i = p0; i < p1; ++i) {
+					particles[i]->setWeight(particles[i]->getWeight() / total);
+				}
+				return;
+			}
+			EstimateMoments & m = filter.chunk_moments[c];
+			Reset(m);
+			m.best = p0;
+			double best_weight = particles[p0]->getWeight();
+			double values[MAX_ESTIMATE_COLUMNS];
+			for (int i = p0; i < p1; ++i) {
+				double w = particles[i]->getWeight();
+				m.sum += w;
+				m.sum_squared += w * w;
+				if (w > best_weight) {
+					best_weight = w;
+					m.best = i;
+				}
+				if (!columns) continue;
+				filter.GetColumns(*particles[i]->getState(), values);
+				for (int k = 0; k < columns; ++k) {
+					values[k] -= shift[k];
+					m.first[k] += w * values[k];
+				}
+				for (int k = 0; k < columns; ++k) {
+					for (int l = 0; l <= k; ++l) m.second[k][l] += w * values[k] * values[l];
+				}
+			}
+		}
+
+		ParticleFilter & filter;
+		int columns;
+		Phase phase;
+		double total;
+		//! The columns of the first particle, subtracted from all columns
+		double shift[MAX_ESTIMATE_COLUMNS];
+	};
+
+	/**
+	 * The phases of BatchLikelihood: the log-likelihoods per chunk and their maximum, and the weights.
+	 */
+	class ParallelLikelihood: public WorkerTask {
+	public:
+		enum Phase { LP_EVALUATE, LP_WEIGH };
+
+		ParallelLikelihood(ParticleFilter & filter): filter(filter), phase(LP_EVALUATE), max(0) {}
+
+		void Run(int begin, int end) {
+			for (int c = begin; c < end; ++c) Chunk(c);
+		}
+
+		void Chunk(int c) {
+			std::vector<Particle<State>* > & particles = filter.set.particles;
+			int N = particles.size();
+			int p0 = c * LIKELIHOOD_CHUNK, p1 = std::min(N, p0 + LIKELIHOOD_CHUNK);
+			double *log_weights = &filter.batch_log_weights[0];
+			if (phase == LP_WEIGH) {
+				filter.Weigh(p0, p1, max);
+				return;
+			}
+			State **states = &filter.batch_states[0];
+			for (int i = p0; i < p1; ++i) {
+				states[i] = particles[i]->getState();
+			}
+			filter.LogLikelihood(states + p0, p1 - p0, log_weights + p0);
+			double chunk_max = -std::numeric_limits<double>::infinity();
+			for (int i = p0; i < p1; ++i) {
+				if (log_weights[i] > chunk_max) chunk_max = log_weights[i];
+			}
+			filter.chunk_max[c] = chunk_max;
+		}
+
+		ParticleFilter & filter;
+		Phase phase;
+		//! The maximum log-likelihood over all chunks
+		double max;
+	};
+
+	//! Set the weights of the particles [begin,end) to exp(l - max), or to zero if the maximum is not finite
+	void Weigh(int begin, int end, double max) {
+		const double *log_weights = &batch_log_weights[0];
+		bool finite = (max > -std::numeric_limits<double>::infinity());
+		for (int i = begin; i < end; ++i) {
+			set.particles[i]->setWeight(finite ? std::exp(log_weights[i] - max) : 0.0);
+		}
+	}
+
+	//! Run a phase over the chunks on the pool, or in this thread if there is none
+	void RunChunks(WorkerTask & task, int chunks) {
+		if (pool != NULL) {
+			pool->Run(task, chunks);
+		} else {
+			task.Run(0, chunks);
+		}
+	}
 
 	//! The actual cloud of particles
 	ParticleSet<State> set;
+
+	//! Worker threads (not owned)
+	WorkerPool *pool;
+
+	//! Partial sums per chunk of the last call to Estimate
+	std::vector<EstimateMoments> chunk_moments;
+
+	//! The estimate of the last resampling step
+	ParticleEstimate last_estimate;
+
+	//! The states of the particles in the order of the batch likelihood
+	std::vector<State*> batch_states;
+
+	//! The log-likelihoods of the batch likelihood
+	std::vector<double> batch_log_weights;
+
+	//! The maximum log-likelihood per chunk of the batch likelihood
+	std::vector<double> chunk_max;
 };
 
 #endif /* PARTICLEFILTER_HPP_ */
@@ -29,8 +29,15 @@
 #include <CImg.h>
 
 #include <Histogram.h>
+#include <ColorSpace.h>
+#include <IntegralHistogram.h>
+#include <BackgroundModel.h>
+#include <FrameFeatures.h>
 #include <Container.hpp>
 #include <Autoregression.hpp>
+#include <LowDiscrepancy.hpp>
+#include <FixedLagSmoother.hpp>
+#include <OfflineSmoother.hpp>
 
 #include <algorithm>
 #include <cassert>
@@ -64,6 +71,9 @@ public:
 		likelihood = 0;
 		width = 0;
 		height = 0;
+		velocity[0] = velocity[1] = 0;
+		velocity_variance[0] = velocity_variance[1] = 0;
+		first_stage = 1;
 	}
 
 	ParticleState(int id): id(id) {
@@ -73,6 +83,9 @@ public:
 		likelihood = 0;
 		width = 0;
 		height = 0;
+		velocity[0] = velocity[1] = 0;
+		velocity_variance[0] = velocity_variance[1] = 0;
+		first_stage = 1;
 	}
 
 	~ParticleState() {
@@ -97,6 +110,14 @@ public:
 	//! A floating point value that scales width and height
 	std::vector<Value> scale;
 
+	//! Mean of the velocity in x and y direction, a Kalman filter per particle (see RBPositionParticleFilter)
+	Value velocity[2];
+	//! Variance of the velocity in x and y direction
+	Value velocity_variance[2];
+
+	//! The first-stage likelihood of the ancestor in the auxiliary particle filter
+	Value first_stage;
+
 	//! Easy printing
 	friend std::ostream& operator<<(std::ostream& os, const ParticleState & ps) {
 		if ((ps.x.size() == 1) && (ps.y.size() == 1)) {
@@ -120,6 +141,11 @@ public:
 		width = other.width;
 		height = other.height;
 		likelihood = other.likelihood;
+		first_stage = other.first_stage;
+		for (int i = 0; i < 2; ++i) {
+			velocity[i] = other.velocity[i];
+			velocity_variance[i] = other.velocity_variance[i];
+		}
 
 		x.clear(); y.clear(); scale.clear();
 		for (int i = 0; i < other.x.size(); ++i) x.push_back(other.x[i]);
@@ -130,6 +156,27 @@ public:
 		ASSERT_EQUAL(x.size(), other.x.size());
 	}
 
+	/**
+	 * Assignment, copies all fields like the copy constructor, including the identifier, so the particle
+	 * becomes an exact duplicate.
+	 */
+	ParticleState & operator=(const ParticleState & other) {
+		if (this == &other) return *this;
+		id = other.id;
+		width = other.width;
+		height = other.height;
+		likelihood = other.likelihood;
+		first_stage = other.first_stage;
+		for (int i = 0; i < 2; ++i) {
+			velocity[i] = other.velocity[i];
+			velocity_variance[i] = other.velocity_variance[i];
+		}
+		x = other.x;
+		y = other.y;
+		scale = other.scale;
+		return *this;
+	}
+
 	inline const int getId() { return id; }
 
 private:
@@ -138,6 +185,96 @@ private:
 };
 
 
+/**
+ * A stage of the cascaded likelihood. It matches a coarse histogram, of which the bins are
+ * merged bins of the full histogram. Merging bins never decreases the Bhattacharyya coefficient,
+ * so the distance of a stage is a lower bound on the distance of the full histogram, and the
+ * likelihood of a stage an upper bound on the full likelihood. A particle that falls below the
+ * threshold at a stage will therefore never make it with the full histogram either (as long as
+ * the same kernel and parts are used, which is the case).
+ */
+struct CascadeStage {
+	//! Number of bins, should divide the number of bins of the full histogram
+	int bins;
+	//! Particles with a likelihood below this threshold are rejected at this stage
+	Value threshold;
+	//! The logarithm of the threshold, to compare with the log-likelihood
+	Value log_threshold;
+	//! Per-frame integral histogram with the coarse bins
+	IntegralHistogram *histogram;
+	//! Reference histogram with merged bins
+	NormalizedHistogramValues reference;
+	//! Number of particles evaluated at this stage, over all ticks since the last reset
+	long evaluated;
+	//! Number of particles rejected at this stage, over all ticks since the last reset
+	long rejected;
+};
+
+/**
+ * The part of a ParticleState that is kept for smoothing, a plain struct so it can be stored in
+ * preallocated arrays.
+ */
+struct PositionSnapshot {
+	//! Horizontal centre
+	Value x;
+	//! Vertical centre
+	Value y;
+	//! Scale of width and height
+	Value scale;
+	//! Likelihood of the particle
+	Value likelihood;
+	//! Horizontal centre predicted by the motion model (without noise) for the next frame
+	Value mean_x;
+	//! Vertical centre predicted by the motion model for the next frame
+	Value mean_y;
+};
+
+/**
+ * An estimate of the region of the tracked object, plain data so that estimates can be written into an
+ * array that is provided (and reused) by the caller.
+ */
+struct RegionEstimate {
+	//! The rectangle, corners inclusive
+	CoordValue x0, y0, x1, y1;
+	//! Horizontal centre
+	Value x;
+	//! Vertical centre
+	Value y;
+	//! The likelihood of the last observation (the mean over the particles for the mean estimate)
+	Value likelihood;
+	//! The weight of the particle (the sum of the weights for the mean estimate)
+	Value weight;
+};
+
+/**
+ * The transition density of the motion model between snapshots of successive frames, divided by its
+ * maximum. The noise is Gaussian around the predicted centre, widened by the rounding of positions to
+ * whole pixels. This is the kernel of the backward pass of the OfflineSmoother.
+ */
+struct PositionTransitionKernel {
+	//! Kernel for transition noise with the given standard deviation
+	PositionTransitionKernel(Value sigma) {
+		inv_two_variance = 1.0 / (2.0 * (sigma * sigma + 1.0 / 12.0));
+	}
+	//! Density of "to" given "from", in [0,1]
+	inline double operator()(const PositionSnapshot & from, const PositionSnapshot & to) {
+		double dx = to.x - from.mean_x, dy = to.y - from.mean_y;
+		return std::exp(-(dx * dx + dy * dy) * inv_two_variance);
+	}
+	double inv_two_variance;
+};
+
+/**
+ * The way a frame is tracked:
+ *   TM_PARTICLES:		the full particle cloud
+ *   TM_SINGLE:			a single hypothesis, refined by mean shift
+ */
+enum TrackingMode {
+	TM_PARTICLES,
+	TM_SINGLE,
+	TM_TYPES
+};
+
 /* **************************************************************************************
  * Interface of PositionParticleFilter
  * **************************************************************************************/
@@ -170,6 +307,17 @@ public:
 	void Init(NormalizedHistogramValues &tracked_object_histogram, CImg<CoordValue> &coord,
 			int particle_count);
 
+	/**
+	 * Initialize particle cloud and calculate the reference histogram(s) from the given frame
+	 * in exactly the same way as the particles will be matched later on: in the same color space,
+	 * with the same kernel and for all parts.
+	 * @param frame							image with the entity to be tracked
+	 * @param coord							CImg coordinates, careful: picks 0,1 3,4 (skips 2)
+	 * @param particle_count				the number of particles to be generated
+	 * @return void
+	 */
+	void Init(CImg<DataValue> &frame, CImg<CoordValue> &coord, int particle_count);
+
 	//! Transition of all particles following a certain motion model
 	void Transition();
 
@@ -177,34 +325,436 @@ public:
 	 * Autoregressive model to estimate where an object will be next. See implementation
 	 * for the actual model used.
 	 */
-	void Transition(ParticleState &oldp);
+	virtual void Transition(ParticleState &oldp);
 
 	/**
-	 * Calculate likelihood of all particles
+	 * The same motion model, but with the noise given as standard normal values, for example from
+	 * a low-discrepancy sequence (see SetQuasiMonteCarlo).
+	 */
+	virtual void Transition(ParticleState &oldp, Value noise_x, Value noise_y);
+
+	/**
+	 * Calculate likelihood of all particles, in batches (see ParticleFilter::BatchLikelihood) on the worker
+	 * pool if there is one
 	 */
 	void Likelihood();
 
 	/**
 	 * Return particles, or more specific, return the coordinates of the particles, ordered
-	 * on weight.
+	 * on weight. The caller owns (and should delete) the coordinates. This sorts the particles
+	 * and allocates for every particle, see GetTopEstimates for the cheaper alternative.
 	 */
 	void GetParticleCoordinates(std::vector<CImg<CoordValue> *> & coordinates);
 
+	/**
+	 * Get the particles with the highest likelihood, best first. The likelihood of a particle is kept with
+	 * its copies, so this works before as well as after resampling. The particles are not sorted, the
+	 * buffer is used as a heap of k estimates, so this takes O(N log k) and does not allocate.
+	 * @param estimates		buffer with room for k estimates
+	 * @param k				the number of estimates
+	 * @return				the number of estimates written (fewer if there are fewer particles)
+	 */
+	int GetTopEstimates(RegionEstimate *estimates, int k);
+
+	/**
+	 * Get the maximum a posteriori estimate, the particle with the highest likelihood.
+	 * @return				false if there are no particles
+	 */
+	bool GetMapEstimate(RegionEstimate & estimate);
+
+	/**
+	 * Get the weighted mean of the positions of the particles. After resampling the weights are all zero
+	 * and every copy counts the same, which is the same estimate as the weighted mean before resampling.
+	 * @return				false if there are no particles
+	 */
+	bool GetMeanEstimate(RegionEstimate & estimate);
+
 	/**
 	 * Return the likelihood of the histogram at all possible positions.
 	 */
 	void GetLikelihoods(CImg<DataValue> & result, RegionSize region_size, int block_size = 8);
+
+	/**
+	 * Set the color space in which the histograms are calculated. The frame is converted once
+	 * per Tick and the result is used for all subticks. Note that the reference histogram that
+	 * is given to Init should be calculated in the same color space, for example by running the
+	 * reference image through a ColorSpaceConverter as well.
+	 */
+	inline void SetColorSpace(ColorSpace color_space) { features->setColorSpace(color_space); }
+
+	/**
+	 * Weigh pixels in the region with an Epanechnikov kernel, so pixels near the border count
+	 * less than those in the centre. The kernel is approximated by the given number of nested
+	 * rectangles, each costing one lookup per bin in the integral histogram. Use 0 (default) for
+	 * the plain rectangle histogram. The reference histogram should be kernel-weighted as well,
+	 * see IntegralHistogram::getKernelProbabilities.
+	 */
+	inline void SetKernelLayers(int layers) { kernel_layers = layers; }
+
+	/**
+	 * Split the region in a grid of parts, each with its own reference histogram, so that for
+	 * example a red shirt above blue trousers can be told apart from the reverse. The likelihood
+	 * uses the mean distance over all parts and costs parts x bins lookups. The reference
+	 * histogram given to Init should contain the parts row by row (see getPartProbabilities
+	 * on IntegralHistogram), or use the Init that takes the frame. Kernel weighting is only
+	 * used if there is a single part.
+	 */
+	inline void SetParts(int columns, int rows) { part_columns = columns; part_rows = rows; }
+
+	/**
+	 * Likelihoods below this value are considered negligible. The distance calculation is then
+	 * abandoned as soon as the likelihood is known to end up below it, and a (smaller) upper
+	 * bound on the likelihood is returned instead. The default of zero evaluates all bins.
+	 */
+	inline void SetMinimumLikelihood(Value min_likelihood) { this->min_likelihood = min_likelihood; }
+
+	/**
+	 * Adapt the reference histogram online to for example changes in lighting. Every subtick the
+	 * histogram at the MAP estimate is blended in with the given learning rate, but only if the
+	 * MAP likelihood is at least min_likelihood (otherwise the object is likely occluded), and only
+	 * if the resulting model stays within max_drift (mean squared Hellinger distance over the parts)
+	 * of the model given at Init.
+	 * @param learning_rate	step towards the observed histogram (0 < mu <= 1), 0 disables updates
+	 * @param min_likelihood	gate on the MAP likelihood
+	 * @param max_drift		maximum distance to the initial model
+	 */
+	inline void SetModelUpdate(Value learning_rate, Value min_likelihood = 0.01, Value max_drift = 0.5) {
+		model_learning_rate = learning_rate;
+		model_min_likelihood = min_likelihood;
+		model_max_drift = max_drift;
+	}
+
+	/**
+	 * For a static camera, maintain a background model and skip particles of which the rectangle
+	 * contains less than a fraction min_coverage of foreground pixels. These get a fixed (low)
+	 * likelihood without calculating a histogram. Use 0 (default) to disable the background model.
+	 * @param min_coverage		minimum fraction of foreground pixels in the rectangle
+	 * @param likelihood		likelihood of particles on the background
+	 */
+	void SetForegroundGate(Value min_coverage, Value likelihood = 1e-6);
+
+	/**
+	 * After the transition, move particles with a few iterations of mean shift towards the mode
+	 * of the likelihood, so that far fewer particles are needed to find it. Only the given number
+	 * of particles with the highest likelihood in the previous tick is moved (0 for all).
+	 * @param iterations		maximum number of mean-shift iterations per particle (0 to disable)
+	 * @param particles		number of particles to refine (0 for all)
+	 */
+	inline void SetMeanShift(int iterations, int particles = 0) {
+		mean_shift_iterations = iterations;
+		mean_shift_particles = particles;
+	}
+
+	/**
+	 * Annealed mode: the subticks of a Tick become layers of an annealed particle filter. Layer
+	 * i of M gets the likelihood exp(-b_i d) with b_i = 20 rate^(M-1-i), so the last layer has
+	 * the normal (sharpest) exponent and the first ones are smoother. Only the first layer uses
+	 * the motion model, the later ones diffuse the current position with a standard deviation of
+	 * noise^i pixels. The model update (if enabled) only uses the last layer.
+	 * @param rate			factor between the exponents of successive layers (0 < rate <= 1), 0 disables
+	 * @param noise			factor between the transition noise of successive layers
+	 */
+	inline void SetAnnealing(Value rate, Value noise = 0.5) {
+		annealing_rate = rate;
+		annealing_noise = noise;
+	}
+
+	/**
+	 * Switch to a single hypothesis if the cloud has been unimodal for a number of frames in a
+	 * row: the effective sample size (as fraction of the number of particles) is at least
+	 * min_ess and the spatial spread (in pixels) is at most max_spread. The single hypothesis
+	 * follows the motion model without noise, is refined by mean shift, and costs one likelihood
+	 * evaluation per frame. If that likelihood drops below min_likelihood, the full cloud is
+	 * used again from the next frame on, and it takes another "frames" frames before the next
+	 * switch.
+	 * @param frames			number of unimodal frames before the switch (0 disables)
+	 * @param max_spread		maximum spread of a unimodal cloud in pixels
+	 * @param min_ess			minimum effective sample size of a unimodal cloud (fraction)
+	 * @param min_likelihood	minimum likelihood of the single hypothesis
+	 * @param mean_shift		maximum number of mean-shift iterations of the single hypothesis
+	 */
+	inline void SetModeSwitch(int frames, Value max_spread = 3.0, Value min_ess = 0.3, Value min_likelihood = 0.1,
+			int mean_shift = 5) {
+		mode_frames = frames;
+		mode_max_spread = max_spread;
+		mode_min_ess = min_ess;
+		mode_min_likelihood = min_likelihood;
+		mode_mean_shift_iterations = mean_shift;
+	}
+
+	/**
+	 * Quasi-Monte Carlo: the transition noise of the particles comes from a (randomly shifted)
+	 * Halton sequence over the particles mapped through the inverse normal CDF, instead of from
+	 * independent draws. The resampling is systematic with the offset taken from a van der Corput
+	 * sequence over the ticks. The noise then covers the proposal much more evenly, so fewer
+	 * particles are needed.
+	 */
+	inline void SetQuasiMonteCarlo(bool enable) {
+		quasi_monte_carlo = enable;
+		halton.setShift(2, drand48());
+	}
+
+	/**
+	 * Resample systematically with a random offset (drand48) instead of with the deterministic
+	 * Resample(), for example to compare pseudo-random noise with quasi-Monte Carlo (which always
+	 * resamples systematically) on equal terms. With a worker pool resampling is always systematic.
+	 */
+	inline void SetSystematicResampling(bool enable) { systematic_resampling = enable; }
+
+	/**
+	 * Auxiliary particle filter: before the transition, every particle is weighted with a cheap
+	 * likelihood (a histogram with fewer bins) at the mean of its prediction, and the particles
+	 * are resampled on that. Only then they are propagated and weighted with the full likelihood
+	 * divided by the first-stage one. This concentrates the particles on those that are likely
+	 * to survive, which helps for jerky motion. The first stage costs one coarse histogram per
+	 * particle and an extra resampling step.
+	 * @param enable		use the auxiliary particle filter
+	 * @param bins			bins of the first-stage histogram, should divide the number of bins
+	 */
+	void SetAuxiliary(bool enable, int bins = 4);
+
+	/**
+	 * Regularized resampling: after resampling, every particle is jittered with a Gaussian kernel
+	 * of which the covariance follows from the weighted covariance of the cloud and the optimal
+	 * bandwidth for the number of particles. Duplicates from resampling then no longer coincide.
+	 * @param factor		multiplies the optimal bandwidth, 0 (default) for plain resampling
+	 */
+	inline void SetRegularization(Value factor) { regularization = factor; }
+
+	/**
+	 * Keep the last generations of particles with their ancestry for fixed-lag smoothing. The
+	 * memory is allocated here: (lag+1) * particle_count snapshots, weights and parent indices.
+	 * Call it after Init (the buffer is cleared there as well). Use a lag of 0 to disable.
+	 * @param lag				the number of generations (ticks) to look back
+	 * @param particle_count	the number of particles
+	 */
+	void SetSmoother(int lag, int particle_count);
+
+	//! Get the smoother, for example to retrieve the lineage of a particle
+	inline FixedLagSmoother<PositionSnapshot> & GetSmoother() { return smoother; }
+
+	/**
+	 * Get the smoothed position "back" ticks ago (at most the lag) given all frames up to now.
+	 * @return				false if there are not enough generations (yet)
+	 */
+	bool GetSmoothedPosition(int back, Value & x, Value & y);
+
+	/**
+	 * Store every frame of the sequence for offline smoothing, for example when a recorded sequence
+	 * is processed as a whole. The storage grows with the sequence and is memory-mapped from a file
+	 * above memory_limit bytes. Call it after Init (the sequence is cleared there as well). Frames
+	 * tracked with a single hypothesis (see SetModeSwitch) are not stored, and the backward pass
+	 * assumes a single generation per frame, so no annealing.
+	 * @param particle_count	the number of particles, 0 to disable
+	 * @param memory_limit		the number of bytes that is kept in memory
+	 */
+	void SetOfflineSmoother(int particle_count, size_t memory_limit = 64 << 20);
+
+	//! Get the offline smoother, for example for the smoothed trajectories themselves
+	inline OfflineSmoother<PositionSnapshot> & GetOfflineSmoother() { return offline_smoother; }
+
+	/**
+	 * Run the backward pass over all frames stored so far (forward-filter backward-smoother with
+	 * rejection sampling, see OfflineSmoother).
+	 * @param trajectories		number of trajectories to draw from the smoothing distribution
+	 * @param max_trials		number of rejections before the exact backward kernel is used
+	 */
+	void SmoothSequence(int trajectories, int max_trials = 32);
+
+	/**
+	 * Get the offline smoothed position of a frame: the mean over the trajectories of the last call
+	 * to SmoothSequence.
+	 * @param frame				index of the frame in the stored sequence
+	 * @return					false if there are no trajectories for this frame
+	 */
+	bool GetOfflinePosition(int frame, Value & x, Value & y);
+
+	//! The mode in which the last frame was tracked (or the next frame will be tracked after a switch)
+	inline TrackingMode GetMode() { return mode; }
+
+	//! Get the background model (only updated if the foreground gate is enabled)
+	inline BackgroundModel & GetBackgroundModel() { return features->getBackgroundModel(); }
+
+	/**
+	 * Use frame features (color conversion, integral histograms, background model) that are shared with
+	 * other filters tracking in the same frame. The owner of the features updates them once per frame, and
+	 * Tick no longer does. The color space is that of the shared features. Use NULL (default) for features
+	 * of this filter itself.
+	 */
+	void SetFrameFeatures(FrameFeatures *shared);
+
+	//! The frame features used by this filter
+	inline FrameFeatures & GetFrameFeatures() { return *features; }
+
+	/**
+	 * The steps of Tick, for a caller that interleaves several filters on the same frame. Per frame call
+	 * BeginFrame, and only if it returns true (the frame is not done with a single hypothesis), per
+	 * subtick Predict, Likelihood (or the ranges of ParticleFilter::BeginBatchLikelihood) and Correct, and
+	 * finally EndFrame.
+	 * @return				false if the frame is done already
+	 */
+	bool BeginFrame();
+
+	//! Everything up to the likelihood for one (annealing) layer of the given number of layers
+	void Predict(int layer, int layers);
+
+	//! Everything after the likelihood for one (annealing) layer, including the resampling
+	void Correct(int layer, int layers);
+
+	//! Finish the frame, for example switch to a single hypothesis
+	void EndFrame();
+
+	/**
+	 * Mark the object as occluded for the coming Correct steps (see MultiTargetTracker). The likelihood is
+	 * then ignored: the particles keep equal weights and only follow the motion model, and the model is not
+	 * updated, so the filter does not lock on to the object in front of it.
+	 */
+	inline void SetOccluded(bool occluded) { this->occluded = occluded; }
+
+	//! Whether the object is marked as occluded
+	inline bool IsOccluded() { return occluded; }
+
+	/**
+	 * Get the current centres of all particles, for example for interaction between filters.
+	 * @param x				room for GetParticleCount() horizontal centres
+	 * @param y				room for GetParticleCount() vertical centres
+	 */
+	void GetPositions(Value *x, Value *y);
+
+	/**
+	 * Multiply the weights of all particles with a factor each, between the likelihood and Correct.
+	 * @param factors		GetParticleCount() factors
+	 */
+	void ScaleWeights(const Value *factors);
+
+	//! Get the current (possibly adapted) reference histogram
+	inline const NormalizedHistogramValues & GetModel() { return tracked_object_histogram; }
+
+	/**
+	 * Add a stage to the cascaded likelihood. Stages are evaluated in the order in which they are
+	 * added, all before the full histogram. A particle of which the likelihood at a stage is below
+	 * the threshold is rejected and gets that likelihood, which is an upper bound of the likelihood
+	 * it would have gotten. For example, AddCascadeStage(4, 0.01) first matches a 4-bin histogram
+	 * and only continues with the 16-bin histogram if that scores at least 0.01.
+	 * @param bins			number of bins, should divide the number of bins (16)
+	 * @param threshold		minimum likelihood to continue to the next stage
+	 */
+	void AddCascadeStage(int bins, Value threshold);
+
+	//! Remove all stages, the full histogram is used for all particles
+	void ClearCascade();
+
+	//! Number of cascade stages
+	inline int GetCascadeStages() { return cascade.size(); }
+
+	/**
+	 * Get the number of particles evaluated and rejected at a stage. The counters are cumulative: they
+	 * count all likelihood evaluations (of all ticks, layers and first stages) since AddCascadeStage or the
+	 * last ResetCascadeCounters. For per-frame numbers, reset them before every Tick.
+	 */
+	void GetCascadeCounters(int stage, long & evaluated, long & rejected);
+
+	//! Reset the counters of all stages
+	void ResetCascadeCounters();
 protected:
+	/**
+	 * Get the histogram of a region the way it is configured: plain, kernel-weighted, or as
+	 * parts. This uses the given integral histogram, which is calculated from the current frame.
+	 */
+	void GetHistogram(IntegralHistogram & histogram, CoordValue x0, CoordValue y0, CoordValue x1,
+			CoordValue y1, NormalizedHistogramValues & result);
+
+	/**
+	 * The distance between a reference and an observed histogram. For multiple parts this is the
+	 * mean distance over the parts. If cutoff is positive, a distance above the cutoff is only
+	 * calculated up to a lower bound that is above the cutoff (see dobots::distance_bounded).
+	 */
+	Value Distance(NormalizedHistogramValues & reference, NormalizedHistogramValues & observed, int bins,
+			Value cutoff = 0);
+
+	//! The current frame (converted to the requested color space)
+	inline CImg<DataValue> * GetImage() { return img; }
+
+	//! True in the later layers of an annealed tick, in which the position is only diffused
+	inline bool IsDiffusionOnly() { return diffusion_only; }
+
+	//! The exponent of the likelihood in the current (annealing) layer
+	inline Value GetLikelihoodExponent() { return likelihood_exponent; }
+
+	//! Merge bins of the reference histogram into the references of the cascade stages
+	void UpdateCascadeReferences();
+
+	//! The horizontal and vertical centre are estimated, see ParticleFilter::Estimate
+	inline int EstimateColumns() { return 2; }
+
+	//! The centre of the region of a particle
+	void GetColumns(ParticleState & state, double *values);
+
+	//! The log-likelihood of a batch of particles, see ParticleFilter::BatchLikelihood
+	void LogLikelihood(ParticleState * const *states, int count, double *log_weights);
+
+	//! Fill in the estimate for a single particle
+	void GetRegionEstimate(Particle<ParticleState> & particle, RegionEstimate & estimate);
+
+	//! The rectangle that is covered by a particle
+	void GetRegion(ParticleState & state, CoordValue & x0, CoordValue & y0, CoordValue & x1, CoordValue & y1);
+
+	//! The rectangle that would be covered by a particle at another position
+	void GetRegion(ParticleState & state, Value x, Value y, CoordValue & x0, CoordValue & y0,
+			CoordValue & x1, CoordValue & y1);
+
+	//! The mean of the motion model for a particle, without noise
+	virtual void PredictMean(ParticleState & state, Value & x, Value & y);
+
+	//! Weigh particles at their predicted mean and resample on that (see SetAuxiliary)
+	void FirstStage();
+
+	//! Store the generation in the smoothers, only for the main resampling step of a tick
+	bool Record();
+
+	//! Resample on a single thread, systematically or not (see SetQuasiMonteCarlo, SetSystematicResampling)
+	void ResampleSerial();
+
+	//! Resample and jitter the particles with a kernel (see SetRegularization)
+	void Regularize();
+
+	//! Merge bins of the reference histogram into the reference of a single stage
+	void FoldReference(CascadeStage & stage);
+
+	//! Blend the histogram at the MAP estimate into the reference histogram (see SetModelUpdate)
+	void UpdateModel();
+
+	//! Blend the histogram in the region of an estimate into the reference histogram
+	void UpdateModel(RegionEstimate & estimate);
+
+	//! Refine the position of (the best) particles with mean shift (see SetMeanShift)
+	void MeanShift();
+
+	//! Mean-shift iterations for a single particle towards the given (single part) histogram
+	void MeanShift(ParticleState & state, NormalizedHistogramValues & target, int iterations);
+
+	//! The reference histogram reduced to a single part, for mean shift
+	void GetMeanShiftTarget(NormalizedHistogramValues & target);
+
+	//! Check if the cloud was unimodal before the last resampling and has been so for long enough (see SetModeSwitch)
+	bool IsUnimodal();
+
+	//! Track the frame with a single hypothesis
+	void TickSingle();
+
+
+	//! The likelihood of a state, the exponential of LogLikelihood
+	float Likelihood(ParticleState & state);
 
 	/**
-	 * Calculate the likelihood of a player and the state indicated by the parameter
+	 * Calculate the log-likelihood of a player and the state indicated by the parameter
 	 * "state" which contains an x and y position, a width and a height. This is used
 	 * to define a rectangle for which a histogram is matched against the reference
 	 * histogram of the object that is tracked.
 	 * @param state			the state of the particle (position, width, height)
-	 * @return				conceptual "distance" to the reference (tracked) object
+	 * @return				minus the scaled distance to the reference (tracked) object
 	 */
-	float Likelihood(ParticleState & state);
+	Value LogLikelihood(ParticleState & state);
 
 private:
 	//! The number of bins
@@ -216,9 +766,153 @@ private:
 	//! Image data
 //	pDataMatrix data;
 
-	//! Image to get data from
+	//! Image to get data from (already converted to the requested color space)
 	CImg<DataValue> * img;
 
+	//! Frame features of this filter itself
+	FrameFeatures own_features;
+
+	//! The frame features that are used, either the own or shared ones
+	FrameFeatures *features;
+
+	//! Per-frame integral histogram of the (converted) image, part of the frame features
+	IntegralHistogram *integral_histogram;
+
+	//! Number of nested rectangles to approximate the kernel with (0 is no kernel)
+	int kernel_layers;
+
+	//! Number of parts in horizontal direction
+	int part_columns;
+
+	//! Number of parts in vertical direction
+	int part_rows;
+
+	//! Likelihood below which the distance calculation may be abandoned (0 for never)
+	Value min_likelihood;
+
+	//! The reference histogram as given at Init, to limit the drift of the adapted model
+	NormalizedHistogramValues initial_object_histogram;
+
+	//! Learning rate of the model update (0 for no update)
+	Value model_learning_rate;
+
+	//! Minimum likelihood of the MAP estimate to update the model
+	Value model_min_likelihood;
+
+	//! Maximum distance of the adapted model to the initial model
+	Value model_max_drift;
+
+	//! Minimum fraction of foreground in the rectangle of a particle (0 for no gate)
+	Value min_coverage;
+
+	//! Likelihood of particles that are rejected by the foreground gate
+	Value background_likelihood;
+
+	//! Maximum number of mean-shift iterations per particle (0 for no mean shift)
+	int mean_shift_iterations;
+
+	//! Number of particles to refine with mean shift (0 for all)
+	int mean_shift_particles;
+
+	//! Factor between exponents of successive annealing layers (0 for no annealing)
+	Value annealing_rate;
+
+	//! Factor between the transition noise of successive annealing layers
+	Value annealing_noise;
+
+	//! The exponent of the likelihood in the current (annealing) layer
+	Value likelihood_exponent;
+
+	//! Standard deviation of the transition noise in the current (annealing) layer
+	Value transition_noise;
+
+	//! Only diffuse the current position, used in all but the first annealing layer
+	bool diffusion_only;
+
+	//! Coefficient for predict to add noise to the current position only
+	std::vector<Value> diffusion_coeff;
+
+	//! Current tracking mode
+	TrackingMode mode;
+
+	//! Number of unimodal frames before switching to a single hypothesis (0 for never)
+	int mode_frames;
+
+	//! Maximum spread of a unimodal cloud
+	Value mode_max_spread;
+
+	//! Minimum effective sample size (fraction) of a unimodal cloud
+	Value mode_min_ess;
+
+	//! Minimum likelihood of the single hypothesis
+	Value mode_min_likelihood;
+
+	//! Maximum number of mean-shift iterations of the single hypothesis
+	int mode_mean_shift_iterations;
+
+	//! Number of frames in a row in which the cloud was unimodal
+	int unimodal_frames;
+
+	//! Weighted mean of the positions in the last check
+	Value mode_x, mode_y;
+
+	//! The current frame is tracked with annealing layers
+	bool annealed;
+
+	//! The current layer started with the first stage of the auxiliary particle filter
+	bool look_ahead;
+
+	//! The cloud was unimodal at the end of the current frame
+	bool unimodal;
+
+	//! The object is occluded, the likelihood is ignored
+	bool occluded;
+
+	//! Use low-discrepancy noise and systematic resampling
+	bool quasi_monte_carlo;
+
+	//! Use systematic resampling with a pseudo-random offset
+	bool systematic_resampling;
+
+	//! Halton sequence for x and y noise, and the resampling offset
+	dobots::HaltonSequence<Value> halton;
+
+	//! Number of ticks with systematic resampling (index in the sequence of offsets)
+	unsigned long qmc_tick;
+
+	//! The coarse histogram of the first stage of the auxiliary particle filter (no histogram if disabled)
+	CascadeStage auxiliary;
+
+	//! Generations for fixed-lag smoothing
+	FixedLagSmoother<PositionSnapshot> smoother;
+
+	//! Whether the smoother is used
+	bool smoothing;
+
+	//! The whole sequence for offline smoothing
+	OfflineSmoother<PositionSnapshot> offline_smoother;
+
+	//! Whether the offline smoother is used
+	bool offline_smoothing;
+
+	//! True during the first stage of the auxiliary particle filter, which is not a generation
+	bool in_first_stage;
+
+	//! Factor on the optimal bandwidth of the regularization kernel (0 for none)
+	Value regularization;
+
+	//! Random number generator of this filter
+	boost::mt19937 random_number_generator;
+
+	//! Standard normal distribution
+	boost::normal_distribution<double> normal_dist;
+
+	//! Standard normal samples
+	boost::variate_generator<boost::mt19937&, boost::normal_distribution<double> > epsilon;
+
+	//! The stages of the cascaded likelihood (can be empty)
+	std::vector<CascadeStage> cascade;
+
 	//! Seed for random number generator
 	int seed;
 
@@ -0,0 +1,110 @@
+/**
+ * @brief Rao-Blackwellized particle filter for position with analytic velocity
+ * @file RBPositionParticleFilter.h
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+
+#ifndef RBPOSITIONPARTICLEFILTER_H_
+#define RBPOSITIONPARTICLEFILTER_H_
+
+#include <PositionParticleFilter.h>
+
+#include <boost/random.hpp>
+#include <boost/random/normal_distribution.hpp>
+
+/* **************************************************************************************
+ * Interface of RBPositionParticleFilter
+ * **************************************************************************************/
+
+/**
+ * A Rao-Blackwellized variant of the PositionParticleFilter. The AR(2) model samples the position
+ * and (implicitly, by the history) the velocity. Here only the position is sampled, the velocity
+ * is marginalized out analytically with a scalar Kalman filter per axis, stored inline in the
+ * ParticleState. Per axis the model is:
+ *   v[n] = v[n-1] + N(0, q)			velocity, random walk
+ *   x[n] = x[n-1] + v[n] + N(0, r)		position
+ * The position is sampled from the predictive distribution N(x[n-1] + m, P + q + r), in which m
+ * and P are the mean and variance of the velocity of the particle. The sampled displacement is
+ * then a measurement of the velocity that updates m and P. Particles do not need to cover all
+ * velocity hypotheses, so fewer of them are needed for the same accuracy.
+ *
+ * The scale is not part of the model, it is fixed to one just like in PositionParticleFilter.
+ */
+class RBPositionParticleFilter: public PositionParticleFilter {
+public:
+	//! Constructor RBPositionParticleFilter
+	RBPositionParticleFilter();
+
+	//! Destructor ~RBPositionParticleFilter
+	virtual ~RBPositionParticleFilter();
+
+	//! Initialise with a reference histogram, the velocity starts at zero with the initial variance
+	void Init(NormalizedHistogramValues &tracked_object_histogram, CImg<CoordValue> &coord,
+			int particle_count);
+
+	//! Initialise with the reference taken from the frame itself
+	void Init(CImg<DataValue> &frame, CImg<CoordValue> &coord, int particle_count);
+
+	//! Sample the position given the velocity distribution, then update the velocity distribution
+	void Transition(ParticleState &state);
+
+	//! The same with given standard normal noise
+	void Transition(ParticleState &state, Value noise_x, Value noise_y);
+
+	/**
+	 * Set the noise of the model in pixels (standard deviations).
+	 * @param position			position noise r
+	 * @param velocity			velocity noise q per time step
+	 * @param initial_velocity	uncertainty in the velocity at Init
+	 */
+	void SetNoise(Value position, Value velocity, Value initial_velocity);
+
+protected:
+	//! Set the velocity of all particles to zero with the initial variance
+	void InitVelocity();
+
+	//! The position moved by the mean velocity of the particle
+	void PredictMean(ParticleState & state, Value & x, Value & y);
+
+	//! Transition and update for one axis with standard normal noise, returns the new position
+	Value Transition(Value position, Value & velocity, Value & velocity_variance, Value noise);
+
+private:
+	//! Variance of the position noise
+	Value position_variance;
+
+	//! Variance of the velocity noise per time step
+	Value process_variance;
+
+	//! Variance of the velocity at Init
+	Value initial_variance;
+
+	//! Random number generator of this filter
+	boost::mt19937 random_number_generator;
+
+	//! Standard normal distribution
+	boost::normal_distribution<Value> normal_dist;
+
+	//! Standard normal samples
+	boost::variate_generator<boost::mt19937&, boost::normal_distribution<Value> > epsilon;
+};
+
+#endif /* RBPOSITIONPARTICLEFILTER_H_ */
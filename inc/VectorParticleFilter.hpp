@@ -0,0 +1,193 @@
+/**
+ * @brief A particle filter for states that are a fixed number of plain numbers
+ * @file VectorParticleFilter.hpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+
+#ifndef VECTORPARTICLEFILTER_HPP_
+#define VECTORPARTICLEFILTER_HPP_
+
+#include <FilterBank.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+//! Number of particles of which the transition noise is drawn at once
+#define TRANSITION_BLOCK 256
+
+/**
+ * The observation model of a VectorParticleFilter, for a batch of particles at once. It is called
+ * concurrently for disjoint ranges if the filter has a worker pool.
+ */
+template <int D, typename T>
+class VectorLikelihood {
+public:
+	virtual ~VectorLikelihood() {}
+
+	/**
+	 * Write the likelihood of the particles [begin,end) to their weights.
+	 * @param columns		D columns, value d of the state of particle i is columns[d][i]
+	 * @param begin			index of the first particle
+	 * @param end			one past the index of the last particle
+	 * @param weights		the weights, indexed the same as the columns
+	 */
+	virtual void operator()(T * const *columns, int begin, int end, double *weights) = 0;
+};
+
+/* **************************************************************************************
+ * Interface of VectorParticleFilter
+ * **************************************************************************************/
+
+/**
+ * A particle filter for a state of D numbers, for example the position and velocity of a robot or the
+ * readings of a sensor, instead of the regions in an image of PositionParticleFilter. The state of all
+ * particles is a single D x N matrix (row d is column d of the FilterBank), so there are no objects per
+ * particle and no pointers to follow.
+ *
+ * The motion model is linear-Gaussian, x' = A x + b + e with e ~ N(0, Q). It is applied to blocks of
+ * TRANSITION_BLOCK particles: first the noise of the block is drawn, then every row of the result is a
+ * sum of D + D rows times a constant, which the compiler vectorizes. The observation model is a
+ * VectorLikelihood that gets the whole matrix and a range of particles, so it can be vectorized as
+ * well.
+ *
+ * It is a FilterBank, so several filters with the same model can run in lockstep; by default there is a
+ * single one.
+ */
+template <int D, typename T = float>
+class VectorParticleFilter: public FilterBank<D, T> {
+public:
+	/**
+	 * Constructor VectorParticleFilter, with the identity as motion model and without noise.
+	 * @param particles		the number of particles N
+	 * @param filters		the number of filters in the bank
+	 */
+	VectorParticleFilter(int particles, int filters = 1): FilterBank<D, T>(filters, particles),
+			likelihood(NULL) {
+		for (int d = 0; d < D; ++d) {
+			for (int e = 0; e < D; ++e) {
+				A[d][e] = (d == e) ? 1 : 0;
+				L[d][e] = 0;
+			}
+			b[d] = 0;
+		}
+	}
+
+	//! Destructor ~VectorParticleFilter
+	virtual ~VectorParticleFilter() {}
+
+	/**
+	 * Set the motion model x' = A x + b + e with e ~ N(0, Q).
+	 * @param A				D x D matrix, row by row
+	 * @param b				D values, NULL for zero
+	 * @param Q				D x D covariance matrix (symmetric, positive definite), row by row
+	 * @return				false if Q is not positive definite, the model is then not changed
+	 */
+	bool SetTransition(const T *A, const T *b, const T *Q) {
+		T chol[D][D];
+		for (int d = 0; d < D; ++d) {
+			for (int e = 0; e < D; ++e) chol[d][e] = 0;
+			for (int e = 0; e <= d; ++e) {
+				double sum = Q[d * D + e];
+				for (int k = 0; k < e; ++k) sum -= chol[d][k] * chol[e][k];
+				if (d == e) {
+					if (!(sum > 0)) return false;
+					chol[d][d] = std::sqrt(sum);
+				} else {
+					chol[d][e] = sum / chol[e][e];
+				}
+			}
+		}
+		for (int d = 0; d < D; ++d) {
+			for (int e = 0; e < D; ++e) {
+				this->A[d][e] = A[d * D + e];
+				L[d][e] = chol[d][e];
+			}
+			this->b[d] = (b != NULL) ? b[d] : 0;
+		}
+		return true;
+	}
+
+	//! Set the observation model (not owned)
+	inline void SetLikelihood(VectorLikelihood<D, T> *likelihood) { this->likelihood = likelihood; }
+
+protected:
+	/**
+	 * The linear-Gaussian motion model, per block of particles. The noise is drawn from the generator of
+	 * the filter the particles belong to, two standard normal values per pair of uniform ones.
+	 */
+	void Transition(int begin, int end) {
+		T noise[D][TRANSITION_BLOCK];
+		T result[D][TRANSITION_BLOCK];
+		T *x[D];
+		for (int d = 0; d < D; ++d) x[d] = this->getColumn(d);
+		int N = this->getParticles();
+		for (int filter = begin / N; filter < end / N; ++filter) {
+			unsigned short *seed = this->getSeed(filter);
+			for (int p0 = filter * N; p0 < (filter + 1) * N; p0 += TRANSITION_BLOCK) {
+				int n = std::min(TRANSITION_BLOCK, (filter + 1) * N - p0);
+				T *z = &noise[0][0];
+				for (int k = 0; k < D * n; k += 2) {
+					double radius = std::sqrt(-2 * std::log(1 - erand48(seed)));
+					double angle = 2 * M_PI * erand48(seed);
+					z[k] = radius * std::cos(angle);
+					if (k + 1 < D * n) z[k + 1] = radius * std::sin(angle);
+				}
+				for (int d = 0; d < D; ++d) {
+					T *r = result[d];
+					for (int j = 0; j < n; ++j) r[j] = b[d];
+					for (int e = 0; e < D; ++e) {
+						T a = A[d][e], l = L[d][e];
+						const T *xe = x[e] + p0;
+						const T *ze = &noise[0][0] + e * n;
+						for (int j = 0; j < n; ++j) r[j] += a * xe[j] + l * ze[j];
+					}
+				}
+				for (int d = 0; d < D; ++d) {
+					std::copy(result[d], result[d] + n, x[d] + p0);
+				}
+			}
+		}
+	}
+
+	//! Hand the range over to the observation model
+	void Likelihood(int begin, int end) {
+		assert (likelihood != NULL);
+		T *columns[D];
+		for (int d = 0; d < D; ++d) columns[d] = this->getColumn(d);
+		(*likelihood)(columns, begin, end, this->getWeights());
+	}
+
+private:
+	//! Transition matrix
+	T A[D][D];
+
+	//! Offset of the transition
+	T b[D];
+
+	//! Lower triangular Cholesky factor of the covariance of the transition noise
+	T L[D][D];
+
+	//! The observation model (not owned)
+	VectorLikelihood<D, T> *likelihood;
+};
+
+#endif /* VECTORPARTICLEFILTER_HPP_ */
@@ -0,0 +1,207 @@
+/**
+ * @brief A fixed pool of worker threads for data-parallel loops
+ * @file WorkerPool.hpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+
+#ifndef WORKERPOOL_HPP_
+#define WORKERPOOL_HPP_
+
+#include <vector>
+#include <algorithm>
+#include <cassert>
+
+#include <pthread.h>
+#include <unistd.h>
+
+/**
+ * A piece of work that can be split in ranges of indices. Run is called concurrently for disjoint
+ * ranges, so it should only write to data that belongs to its own range.
+ */
+class WorkerTask {
+public:
+	virtual ~WorkerTask() {}
+
+	//! Do the work for the indices [begin,end)
+	virtual void Run(int begin, int end) = 0;
+};
+
+/* **************************************************************************************
+ * Interface of WorkerPool
+ * **************************************************************************************/
+
+/**
+ * A fixed number of threads that execute a WorkerTask over a range of indices. The range is cut in
+ * ranges of "grain" indices, which are handed out one by one to whichever thread is free, so the load
+ * is balanced. The calling thread takes part in the work and Run returns when all ranges are done.
+ *
+ * How the ranges are cut does not depend on the number of threads. A task that computes something
+ * per range (for example a partial sum) and combines the ranges in order afterwards therefore gets
+ * exactly the same result with one thread as with many.
+ *
+ * The threads are started once, in the constructor, and wait on a condition variable in between. A
+ * pool with a single worker starts no threads at all and runs everything in the calling thread. Run
+ * itself should not be called concurrently, nor from within a task.
+ */
+class WorkerPool {
+public:
+	/**
+	 * Constructor WorkerPool
+	 * @param workers		number of threads including the caller, 0 for the number of processors
+	 */
+	WorkerPool(int workers = 0): task(NULL), count(0), grain(1), next(0), active(0), generation(0),
+			stop(false) {
+		if (workers <= 0) workers = std::max(1, (int)sysconf(_SC_NPROCESSORS_ONLN));
+		this->workers = workers;
+		pthread_mutex_init(&mutex, NULL);
+		pthread_cond_init(&start_condition, NULL);
+		pthread_cond_init(&done_condition, NULL);
+		threads.resize(workers - 1);
+		for (size_t i = 0; i < threads.size(); ++i) {
+			pthread_create(&threads[i], NULL, &WorkerPool::Loop, this);
+		}
+	}
+
+	//! Destructor ~WorkerPool, stops and joins the threads
+	virtual ~WorkerPool() {
+		pthread_mutex_lock(&mutex);
+		stop = true;
+		pthread_cond_broadcast(&start_condition);
+		pthread_mutex_unlock(&mutex);
+		for (size_t i = 0; i < threads.size(); ++i) {
+			pthread_join(threads[i], NULL);
+		}
+		pthread_cond_destroy(&done_condition);
+		pthread_cond_destroy(&start_condition);
+		pthread_mutex_destroy(&mutex);
+	}
+
+	//! The number of threads that work on a task, including the caller
+	inline int getWorkers() { return workers; }
+
+	/**
+	 * Run a task over the indices [0,count) and wait for it to finish.
+	 * @param task			the work to do
+	 * @param count			the number of indices
+	 * @param grain			the number of indices per call of WorkerTask::Run
+	 */
+	void Run(WorkerTask & task, int count, int grain = 1) {
+		assert (grain > 0);
+		if (count <= 0) return;
+		if (threads.empty() || count <= grain) {
+			for (int begin = 0; begin < count; begin += grain) {
+				task.Run(begin, std::min(count, begin + grain));
+			}
+			return;
+		}
+		pthread_mutex_lock(&mutex);
+		this->task = &task;
+		this->count = count;
+		this->grain = grain;
+		next = 0;
+		active = threads.size();
+		generation++;
+		pthread_cond_broadcast(&start_condition);
+		pthread_mutex_unlock(&mutex);
+
+		Work();
+
+		pthread_mutex_lock(&mutex);
+		while (active > 0) pthread_cond_wait(&done_condition, &mutex);
+		this->task = NULL;
+		pthread_mutex_unlock(&mutex);
+	}
+
+protected:
+	//! Take ranges until there are none left
+	void Work() {
+		int ranges = (count + grain - 1) / grain;
+		for (;;) {
+			int r = __sync_fetch_and_add(&next, 1);
+			if (r >= ranges) break;
+			int begin = r * grain;
+			task->Run(begin, std::min(count, begin + grain));
+		}
+	}
+
+	//! The loop of every thread: wait for a new task, work on it, report back
+	static void *Loop(void *arg) {
+		WorkerPool *pool = static_cast<WorkerPool*>(arg);
+		unsigned long seen = 0;
+		pthread_mutex_lock(&pool->mutex);
+		for (;;) {
+			while (pool->generation == seen && !pool->stop) {
+				pthread_cond_wait(&pool->start_condition, &pool->mutex);
+			}
+			if (pool->stop) break;
+			seen = pool->generation;
+			pthread_mutex_unlock(&pool->mutex);
+			pool->Work();
+			pthread_mutex_lock(&pool->mutex);
+			if (--pool->active == 0) pthread_cond_signal(&pool->done_condition);
+		}
+		pthread_mutex_unlock(&pool->mutex);
+		return NULL;
+	}
+
+private:
+	//! Number of workers including the caller
+	int workers;
+
+	//! The threads besides the caller
+	std::vector<pthread_t> threads;
+
+	//! The current task
+	WorkerTask *task;
+
+	//! Number of indices of the current task
+	int count;
+
+	//! Number of indices per range
+	int grain;
+
+	//! The next range to hand out
+	volatile int next;
+
+	//! Number of threads that are still working on the current task
+	int active;
+
+	//! Incremented for every task, so the threads can tell a new task from a spurious wake-up
+	unsigned long generation;
+
+	//! Set to stop the threads
+	bool stop;
+
+	//! Protects everything above
+	pthread_mutex_t mutex;
+
+	//! Signals a new task (or stop)
+	pthread_cond_t start_condition;
+
+	//! Signals that the last thread is done
+	pthread_cond_t done_condition;
+
+	//! Not copyable (owns the threads)
+	WorkerPool(const WorkerPool &);
+	WorkerPool & operator=(const WorkerPool &);
+};
+
+#endif /* WORKERPOOL_HPP_ */
@@ -0,0 +1,150 @@
+/**
+ * @brief Per-pixel background model with foreground mask
+ * @file BackgroundModel.cpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+#include <BackgroundModel.h>
+
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+
+using namespace std;
+
+/* **************************************************************************************
+ * Implementation of BackgroundModel
+ * **************************************************************************************/
+
+BackgroundModel::BackgroundModel(Value learning_rate, Value threshold, Value min_variance):
+		learning_rate(learning_rate),
+		threshold(threshold),
+		min_variance(min_variance),
+		width(0),
+		height(0),
+		frame_count(0),
+		mean(NULL),
+		variance(NULL),
+		mask(NULL),
+		integral(NULL) {
+	assert (learning_rate > 0 && learning_rate <= 1);
+}
+
+BackgroundModel::~BackgroundModel() {
+	Clear();
+}
+
+void BackgroundModel::Clear() {
+	if (mean != NULL) delete [] mean;
+	if (variance != NULL) delete [] variance;
+	if (mask != NULL) delete [] mask;
+	if (integral != NULL) delete [] integral;
+	mean = variance = NULL;
+	mask = NULL;
+	integral = NULL;
+	width = height = 0;
+	frame_count = 0;
+}
+
+void BackgroundModel::Reset() {
+	frame_count = 0;
+}
+
+void BackgroundModel::Allocate(int width, int height) {
+	if (width == this->width && height == this->height && integral != NULL) return;
+	Clear();
+	this->width = width;
+	this->height = height;
+#ifdef VERBOSE
+	cout << __func__ << ": Create background model of size " << width << "x" << height << endl;
+#endif
+	mean = new Value[width * height];
+	variance = new Value[width * height];
+	mask = new DataValue[width * height];
+	integral = new HistogramValue[(width+1) * (height+1)];
+	// the first row and the first column stay zero
+	std::fill_n(integral, (width+1) * (height+1), (HistogramValue)0);
+}
+
+/**
+ * Classification and update are one pass over the pixels. The update is written with selects
+ * (the learning rate is zero for foreground pixels), so the loop has no branches.
+ */
+void BackgroundModel::Update(CImg<DataValue> & frame) {
+	Allocate(frame._width, frame._height);
+
+	int size = width * height;
+	int channels = frame._spectrum;
+	const DataValue *data = frame._data;
+	int plane = size * frame._depth;
+	Value inv_channels = Value(1) / channels;
+
+	if (frame_count == 0) {
+		for (int p = 0; p < size; ++p) {
+			int sum = 0;
+			for (int c = 0; c < channels; ++c) sum += data[c * plane + p];
+			mean[p] = sum * inv_channels;
+			variance[p] = min_variance;
+			mask[p] = 0;
+		}
+	} else {
+		Value threshold_squared = threshold * threshold;
+		for (int p = 0; p < size; ++p) {
+			int sum = 0;
+			for (int c = 0; c < channels; ++c) sum += data[c * plane + p];
+			Value diff = sum * inv_channels - mean[p];
+			Value diff_squared = diff * diff;
+			int foreground = diff_squared > threshold_squared * variance[p];
+			Value alpha = foreground ? Value(0) : learning_rate;
+			mean[p] += alpha * diff;
+			Value var = variance[p] + alpha * (diff_squared - variance[p]);
+			variance[p] = var < min_variance ? min_variance : var;
+			mask[p] = foreground;
+		}
+	}
+	frame_count++;
+
+	for (int y = 0; y < height; ++y) {
+		const DataValue *row = mask + y * width;
+		const HistogramValue *above = integral + y * (width+1) + 1;
+		HistogramValue *current = integral + (y+1) * (width+1) + 1;
+		HistogramValue sum = 0;
+		for (int x = 0; x < width; ++x) {
+			sum += row[x];
+			current[x] = above[x] + sum;
+		}
+	}
+}
+
+int BackgroundModel::getForeground(int x0, int y0, int x1, int y1) {
+	assert (integral != NULL);
+	int cx0 = std::max(x0, 0), cy0 = std::max(y0, 0);
+	int cx1 = std::min(x1, width-1), cy1 = std::min(y1, height-1);
+	if (cx0 > cx1 || cy0 > cy1) return 0;
+	int stride = width+1;
+	return integral[(cy1+1) * stride + cx1+1] - integral[cy0 * stride + cx1+1]
+			- integral[(cy1+1) * stride + cx0] + integral[cy0 * stride + cx0];
+}
+
+Value BackgroundModel::getCoverage(int x0, int y0, int x1, int y1) {
+	int area = (x1 - x0 + 1) * (y1 - y0 + 1);
+	if (area <= 0) return Value(0);
+	return getForeground(x0, y0, x1, y1) / Value(area);
+}
@@ -0,0 +1,150 @@
+/**
+ * @brief Per-frame color space conversion for planar images
+ * @file ColorSpace.cpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+#include <ColorSpace.h>
+
+#include <iostream>
+#include <cassert>
+
+using namespace std;
+
+/* **************************************************************************************
+ * Implementation of ColorSpaceConverter
+ * **************************************************************************************/
+
+ColorSpaceConverter::ColorSpaceConverter(ColorSpace color_space): color_space(color_space) {
+
+}
+
+ColorSpaceConverter::~ColorSpaceConverter() {
+
+}
+
+/**
+ * Convert the frame as a whole. The output image is only reallocated if the frame size
+ * changes, so for a video stream this does not touch the heap.
+ */
+CImg<DataValue> & ColorSpaceConverter::Convert(CImg<DataValue> & frame) {
+	if (color_space == CS_RGB) return frame;
+	if (frame._spectrum < 3) {
+#ifdef VERBOSE
+		cout << __func__ << ": frame has less than three channels, no conversion" << endl;
+#endif
+		return frame;
+	}
+
+	converted.assign(frame._width, frame._height, frame._depth, 3);
+
+	int size = frame._width * frame._height * frame._depth;
+	const DataValue *r = frame._data;
+	const DataValue *g = r + size;
+	const DataValue *b = g + size;
+	DataValue *c0 = converted._data;
+	DataValue *c1 = c0 + size;
+	DataValue *c2 = c1 + size;
+
+	switch (color_space) {
+	case CS_YCBCR:
+		convertYCbCr(r, g, b, c0, c1, c2, size);
+		break;
+	case CS_HSV:
+		convertHSV(r, g, b, c0, c1, c2, size);
+		break;
+	case CS_NORMALIZED_RG:
+		convertNormalizedRG(r, g, b, c0, c1, c2, size);
+		break;
+	default:
+		cerr << "Unknown color space" << endl;
+		return frame;
+	}
+	return converted;
+}
+
+/**
+ * The JPEG conversion with coefficients scaled by 256:
+ *   Y  =       0.299 R + 0.587 G + 0.114 B
+ *   Cb = 128 - 0.169 R - 0.331 G + 0.500 B
+ *   Cr = 128 + 0.500 R - 0.419 G - 0.081 B
+ * The offset of 128 (times 256) keeps all intermediate values positive, so the shift is well
+ * defined. Only the upper end needs to be clamped.
+ */
+void ColorSpaceConverter::convertYCbCr(const DataValue * __restrict__ r, const DataValue * __restrict__ g,
+		const DataValue * __restrict__ b, DataValue * __restrict__ y, DataValue * __restrict__ cb,
+		DataValue * __restrict__ cr, int size) {
+	for (int p = 0; p < size; ++p) {
+		int R = r[p], G = g[p], B = b[p];
+		int Y  = (77 * R + 150 * G + 29 * B + 128) >> 8;
+		int Cb = (-43 * R - 85 * G + 128 * B + 32768 + 128) >> 8;
+		int Cr = (128 * R - 107 * G - 21 * B + 32768 + 128) >> 8;
+		y[p] = Y;
+		cb[p] = Cb > 255 ? 255 : Cb;
+		cr[p] = Cr > 255 ? 255 : Cr;
+	}
+}
+
+/**
+ * Hue is calculated in sextants and scaled such that a full turn covers [0,255). Saturation
+ * and value are in [0,255]. For grey pixels (no chroma) hue and saturation are zero.
+ */
+void ColorSpaceConverter::convertHSV(const DataValue * __restrict__ r, const DataValue * __restrict__ g,
+		const DataValue * __restrict__ b, DataValue * __restrict__ h, DataValue * __restrict__ s,
+		DataValue * __restrict__ v, int size) {
+	const float sextant = 255.0f / 6.0f;
+	for (int p = 0; p < size; ++p) {
+		int R = r[p], G = g[p], B = b[p];
+		int max = R > G ? R : G;
+		max = max > B ? max : B;
+		int min = R < G ? R : G;
+		min = min < B ? min : B;
+		int delta = max - min;
+		// the sextant is selected with integer comparisons, only the final scaling is in floats
+		// (plain selects instead of std::max keep the loop vectorizable)
+		int turn = 4 * delta + R - G;
+		turn = (max == G) ? 2 * delta + B - R : turn;
+		turn = (max == R) ? G - B : turn;
+		turn += (turn < 0) ? 6 * delta : 0;
+		float hue = turn * sextant / (float)(delta > 1 ? delta : 1);
+		float sat = 255.0f * delta / (float)(max > 1 ? max : 1);
+		h[p] = (int)hue;
+		s[p] = (int)(sat + 0.5f);
+		v[p] = max;
+	}
+}
+
+/**
+ * Chromaticity coordinates are invariant to the intensity of the illumination. The third channel
+ * keeps the intensity itself, so nothing is lost. Black pixels are mapped onto the neutral point
+ * (r = g = 1/3).
+ */
+void ColorSpaceConverter::convertNormalizedRG(const DataValue * __restrict__ r, const DataValue * __restrict__ g,
+		const DataValue * __restrict__ b, DataValue * __restrict__ nr, DataValue * __restrict__ ng,
+		DataValue * __restrict__ i, int size) {
+	for (int p = 0; p < size; ++p) {
+		int sum = r[p] + g[p] + b[p];
+		int black = (sum == 0);
+		float inv_sum = 255.0f / (sum + 3 * black);
+		nr[p] = (int)((r[p] + black) * inv_sum + 0.5f);
+		ng[p] = (int)((g[p] + black) * inv_sum + 0.5f);
+		i[p] = (sum + 1) / 3;
+	}
+}
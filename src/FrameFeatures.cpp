@@ -0,0 +1,94 @@
+/**
+ * @brief Per-frame structures that are shared by all filters tracking in the same frame
+ * @file FrameFeatures.cpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+#include <FrameFeatures.h>
+
+#include <iostream>
+#include <cassert>
+
+using namespace std;
+
+/* **************************************************************************************
+ * Implementation of FrameFeatures
+ * **************************************************************************************/
+
+FrameFeatures::FrameFeatures(): img(NULL), background_users(0), frame_count(0) {
+
+}
+
+FrameFeatures::~FrameFeatures() {
+	std::map<int, RequiredHistogram>::iterator i;
+	for (i = histograms.begin(); i != histograms.end(); ++i) {
+		delete i->second.histogram;
+	}
+	histograms.clear();
+}
+
+void FrameFeatures::Update(CImg<DataValue> & frame) {
+	if (background_users > 0) {
+		background.Update(frame);
+	}
+	img = &converter.Convert(frame);
+	std::map<int, RequiredHistogram>::iterator i;
+	for (i = histograms.begin(); i != histograms.end(); ++i) {
+		i->second.histogram->Update(*img);
+	}
+	frame_count++;
+}
+
+/**
+ * A histogram that is added in between frames is calculated right away, so it can be used with the
+ * current frame.
+ */
+IntegralHistogram * FrameFeatures::Require(int bins) {
+	std::map<int, RequiredHistogram>::iterator i = histograms.find(bins);
+	if (i != histograms.end()) {
+		i->second.users++;
+		return i->second.histogram;
+	}
+	RequiredHistogram & required = histograms[bins];
+	required.histogram = new IntegralHistogram(bins);
+	required.users = 1;
+	if (img != NULL) required.histogram->Update(*img);
+#ifdef VERBOSE
+	cout << __func__ << ": Calculate integral histogram with " << bins << " bins" << endl;
+#endif
+	return required.histogram;
+}
+
+void FrameFeatures::Release(int bins) {
+	std::map<int, RequiredHistogram>::iterator i = histograms.find(bins);
+	assert (i != histograms.end());
+	if (--i->second.users > 0) return;
+	delete i->second.histogram;
+	histograms.erase(i);
+}
+
+void FrameFeatures::RequireBackground() {
+	background_users++;
+}
+
+void FrameFeatures::ReleaseBackground() {
+	assert (background_users > 0);
+	background_users--;
+}
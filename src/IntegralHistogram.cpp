@@ -0,0 +1,289 @@
+/**
+ * @brief Integral histogram over an entire frame
+ * @file IntegralHistogram.cpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+#include <IntegralHistogram.h>
+
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+
+using namespace std;
+
+//! Maximum number of bins, every bin index should fit in a DataValue
+#define MAX_BINS 256
+
+/* **************************************************************************************
+ * Implementation of IntegralHistogram
+ * **************************************************************************************/
+
+IntegralHistogram::IntegralHistogram(int bins): bins(bins),
+		width(0),
+		height(0),
+		bin_plane(NULL),
+		integral(NULL) {
+	assert (bins > 0 && bins <= MAX_BINS);
+	row_sum.resize(bins);
+	for (int s = 0; s < KERNEL_TILE_SLOTS; ++s) {
+		kernel_tiles[s].state = kernel_tiles[s].conflict = 0;
+	}
+}
+
+IntegralHistogram::~IntegralHistogram() {
+	Clear();
+}
+
+void IntegralHistogram::Clear() {
+	if (bin_plane != NULL) delete [] bin_plane;
+	if (integral != NULL) delete [] integral;
+	bin_plane = NULL;
+	integral = NULL;
+	width = height = 0;
+}
+
+void IntegralHistogram::Allocate(int width, int height) {
+	if (width == this->width && height == this->height && integral != NULL) return;
+	Clear();
+	this->width = width;
+	this->height = height;
+#ifdef VERBOSE
+	cout << __func__ << ": Create integral histogram of size " << width+1 << "x" << height+1 << "x" << bins << endl;
+#endif
+	bin_plane = new DataValue[width * height];
+	integral = new HistogramValue[(width+1) * (height+1) * bins];
+	// the first row and the first column stay zero
+	std::fill_n(integral, (width+1) * (height+1) * bins, (HistogramValue)0);
+}
+
+/**
+ * The integral histogram is built row by row. A running histogram of the current row is added
+ * to the integral histogram of the row above:
+ *   I(x+1,y+1,b) = I(x+1,y,b) + sum_{i<=x} [bin(i,y) == b]
+ * The inner loop over the bins has no dependencies and is vectorized by the compiler.
+ */
+void IntegralHistogram::Update(CImg<DataValue> & frame, int channel) {
+	assert (channel < (int)frame._spectrum);
+	Allocate(frame._width, frame._height);
+	for (int s = 0; s < KERNEL_TILE_SLOTS; ++s) {
+		if (kernel_tiles[s].conflict) kernel_tiles[s].state = kernel_tiles[s].conflict = 0;
+	}
+
+	const DataValue *data = frame._data + channel * width * height * frame._depth;
+	for (int p = 0; p < width * height; ++p) {
+		bin_plane[p] = (data[p] * bins) >> 8;
+	}
+
+	int stride = (width+1) * bins;
+	for (int y = 0; y < height; ++y) {
+		std::fill(row_sum.begin(), row_sum.end(), (HistogramValue)0);
+		const DataValue *row = bin_plane + y * width;
+		const HistogramValue *above = integral + y * stride + bins;
+		HistogramValue *current = integral + (y+1) * stride + bins;
+		HistogramValue *sum = &row_sum[0];
+		for (int x = 0; x < width; ++x) {
+			sum[row[x]]++;
+			for (int b = 0; b < bins; ++b) {
+				current[b] = above[b] + sum[b];
+			}
+			above += bins;
+			current += bins;
+		}
+	}
+}
+
+/**
+ * Four lookups per bin for the part of the rectangle within the frame. The part outside the frame
+ * is added to bin 0.
+ */
+int IntegralHistogram::getFrequencies(int x0, int y0, int x1, int y1, HistogramValue *result) {
+	assert (integral != NULL);
+	int area = (x1 - x0 + 1) * (y1 - y0 + 1);
+	if (area <= 0) {
+		std::fill_n(result, bins, (HistogramValue)0);
+		return 0;
+	}
+	int cx0 = std::max(x0, 0), cy0 = std::max(y0, 0);
+	int cx1 = std::min(x1, width-1), cy1 = std::min(y1, height-1);
+	if (cx0 > cx1 || cy0 > cy1) {
+		std::fill_n(result, bins, (HistogramValue)0);
+		result[0] = area;
+		return area;
+	}
+	int stride = (width+1) * bins;
+	const HistogramValue *a = integral + cy0 * stride + cx0 * bins;
+	const HistogramValue *b = integral + cy0 * stride + (cx1+1) * bins;
+	const HistogramValue *c = integral + (cy1+1) * stride + cx0 * bins;
+	const HistogramValue *d = integral + (cy1+1) * stride + (cx1+1) * bins;
+	for (int i = 0; i < bins; ++i) {
+		result[i] = d[i] - b[i] - c[i] + a[i];
+	}
+	result[0] += area - (cx1 - cx0 + 1) * (cy1 - cy0 + 1);
+	return area;
+}
+
+void IntegralHistogram::getProbabilities(int x0, int y0, int x1, int y1, NormalizedHistogramValues & result) {
+	HistogramValue freq[MAX_BINS];
+	int area = getFrequencies(x0, y0, x1, y1, freq);
+	result.resize(bins);
+	assert (area != 0);
+	Value factor = Value(1) / area;
+	for (int i = 0; i < bins; ++i) {
+		result[i] = freq[i] * factor;
+	}
+}
+
+/**
+ * The region is split as evenly as possible. If the region is smaller than the grid, parts are
+ * one pixel wide (or high) and overlap.
+ */
+void IntegralHistogram::getPartProbabilities(int x0, int y0, int x1, int y1, int columns, int rows,
+		NormalizedHistogramValues & result) {
+	assert (columns > 0 && rows > 0);
+	HistogramValue freq[MAX_BINS];
+	result.resize(columns * rows * bins);
+	int w = x1 - x0 + 1, h = y1 - y0 + 1;
+	Value *part = &result[0];
+	for (int r = 0; r < rows; ++r) {
+		int py0 = y0 + (r * h) / rows;
+		int py1 = std::max(py0, y0 + ((r+1) * h) / rows - 1);
+		for (int c = 0; c < columns; ++c) {
+			int px0 = x0 + (c * w) / columns;
+			int px1 = std::max(px0, x0 + ((c+1) * w) / columns - 1);
+			int area = getFrequencies(px0, py0, px1, py1, freq);
+			Value factor = Value(1) / area;
+			for (int i = 0; i < bins; ++i) {
+				part[i] = freq[i] * factor;
+			}
+			part += bins;
+		}
+	}
+}
+
+/**
+ * The kernel-weighted histogram is a weighted sum of the histograms of the nested rectangles.
+ * With coefficients from the kernel tile this costs "layers" ordinary queries.
+ */
+void IntegralHistogram::getKernelProbabilities(int x0, int y0, int x1, int y1, int layers,
+		NormalizedHistogramValues & result) {
+	KernelTile scratch;
+	const KernelTile & tile = getKernelTile(x1 - x0 + 1, y1 - y0 + 1, layers, scratch);
+	HistogramValue freq[MAX_BINS];
+	result.assign(bins, Value(0));
+	for (int l = 0; l < layers; ++l) {
+		Value c = tile.coefficient[l];
+		if (c == Value(0)) continue;
+		int ox = tile.offset_x[l], oy = tile.offset_y[l];
+		getFrequencies(x0 + ox, y0 + oy, x1 - ox, y1 - oy, freq);
+		for (int i = 0; i < bins; ++i) {
+			result[i] += c * freq[i];
+		}
+	}
+	assert (tile.total > 0);
+	Value factor = Value(1) / tile.total;
+	for (int i = 0; i < bins; ++i) {
+		result[i] *= factor;
+	}
+}
+
+/**
+ * A slot goes from empty to being calculated with a compare-and-swap, so only one query fills it. The
+ * tile is written before the slot is marked as ready (with a full barrier in between), and a query
+ * that sees a ready slot reads the tile after a barrier as well. Ready slots are only freed in Update.
+ */
+const KernelTile & IntegralHistogram::getKernelTile(int region_width, int region_height, int layers,
+		KernelTile & scratch) {
+	unsigned int hash = (unsigned int)region_width * 73856093u ^ (unsigned int)region_height * 19349663u ^
+			(unsigned int)layers * 83492791u;
+	KernelTileSlot & slot = kernel_tiles[hash % KERNEL_TILE_SLOTS];
+	if (slot.state == 2) {
+		__sync_synchronize();
+		if (slot.width == region_width && slot.height == region_height && slot.layers == layers) {
+			return slot.tile;
+		}
+		slot.conflict = 1;
+	} else if (__sync_bool_compare_and_swap(&slot.state, 0, 1)) {
+		slot.width = region_width;
+		slot.height = region_height;
+		slot.layers = layers;
+		calcKernelTile(region_width, region_height, layers, slot.tile);
+		__sync_synchronize();
+		slot.state = 2;
+		return slot.tile;
+	}
+	calcKernelTile(region_width, region_height, layers, scratch);
+	return scratch;
+}
+
+/**
+ * Rectangle l (from 0 for the innermost to layers-1 for the region itself) is shrunk by
+ *   offset = ((layers - 1 - l) * (size / 2)) / layers
+ * at each side, so it is never empty. Every pixel of the region is assigned to the innermost
+ * rectangle that contains it, its ring. The weight of a ring is the mean of the Epanechnikov
+ * profile k(r) = 1 - r^2 over its pixels, with r the distance to the centre normalized by the half
+ * width and half height of the region. Because a pixel in ring l is contained in rectangles
+ * l..layers-1, the coefficient of rectangle l is the difference between the weight of ring l and
+ * that of ring l+1. The profile decreases outwards, so these are (up to rounding) not negative.
+ */
+void IntegralHistogram::calcKernelTile(int region_width, int region_height, int layers, KernelTile & tile) {
+	assert (layers > 0);
+	assert (region_width > 0 && region_height > 0);
+	tile.offset_x.resize(layers);
+	tile.offset_y.resize(layers);
+	tile.coefficient.assign(layers, Value(0));
+	for (int l = 0; l < layers; ++l) {
+		tile.offset_x[l] = ((layers - 1 - l) * (region_width / 2)) / layers;
+		tile.offset_y[l] = ((layers - 1 - l) * (region_height / 2)) / layers;
+	}
+
+	std::vector<Value> ring_weight(layers, Value(0));
+	std::vector<int> ring_count(layers, 0);
+	Value cx = (region_width - 1) / Value(2), cy = (region_height - 1) / Value(2);
+	Value hw = std::max(region_width / Value(2), Value(1)), hh = std::max(region_height / Value(2), Value(1));
+	for (int j = 0; j < region_height; ++j) {
+		for (int i = 0; i < region_width; ++i) {
+			int dx = std::min(i, region_width - 1 - i);
+			int dy = std::min(j, region_height - 1 - j);
+			int l = 0;
+			while (dx < tile.offset_x[l] || dy < tile.offset_y[l]) ++l;
+			Value rx = (i - cx) / hw, ry = (j - cy) / hh;
+			ring_weight[l] += std::max(Value(0), Value(1) - rx*rx - ry*ry);
+			ring_count[l]++;
+		}
+	}
+
+	for (int l = 0; l < layers; ++l) {
+		if (ring_count[l]) ring_weight[l] /= ring_count[l];
+	}
+	for (int l = 0; l < layers; ++l) {
+		Value next = (l + 1 < layers) ? ring_weight[l+1] : Value(0);
+		tile.coefficient[l] = std::max(Value(0), ring_weight[l] - next);
+	}
+	// the normalization follows from the (possibly clipped) coefficients and the rectangle areas
+	tile.total = 0;
+	for (int l = 0; l < layers; ++l) {
+		int w = region_width - 2 * tile.offset_x[l], h = region_height - 2 * tile.offset_y[l];
+		tile.total += tile.coefficient[l] * w * h;
+	}
+#ifdef VERBOSE
+	cout << __func__ << ": Kernel tile for " << region_width << "x" << region_height << " with " << layers << " layers" << endl;
+#endif
+}
@@ -0,0 +1,171 @@
+/**
+ * @brief Monte Carlo localization of a robot with a range sensor in an occupancy grid map
+ * @file MonteCarloLocalization.cpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+#include <MonteCarloLocalization.h>
+
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+/* **************************************************************************************
+ * Implementation of MonteCarloLocalization
+ * **************************************************************************************/
+
+MonteCarloLocalization::MonteCarloLocalization(OccupancyGrid & map, int particles):
+		FilterBank<3, Value>(1, particles), map(map) {
+	max_range = 10;
+	rotation1 = translation = rotation2 = 0;
+	noise_rotation = 0.05;
+	noise_translation = 0.05;
+	noise_rotation_translation = 0.01;
+	noise_translation_rotation = 0.01;
+	log_likelihoods.resize(particles);
+}
+
+MonteCarloLocalization::~MonteCarloLocalization() {
+
+}
+
+void MonteCarloLocalization::SetSensor(const Value *angles, int beams, Value max_range, int step) {
+	assert (step > 0);
+	this->max_range = max_range;
+	beam_cos.clear();
+	beam_sin.clear();
+	beam_index.clear();
+	for (int b = 0; b < beams; b += step) {
+		beam_cos.push_back(std::cos(angles[b]));
+		beam_sin.push_back(std::sin(angles[b]));
+		beam_index.push_back(b);
+	}
+	ranges.resize(beams);
+}
+
+void MonteCarloLocalization::InitGlobal() {
+	std::vector<int> free;
+	map.GetFreeCells(free);
+	assert (!free.empty());
+	unsigned short *seed = getSeed(0);
+	Value *x = getColumn(0), *y = getColumn(1), *theta = getColumn(2);
+	Value resolution = map.getResolution();
+	for (int i = 0; i < getParticles(); ++i) {
+		int cell = free[std::min((int)free.size() - 1, (int)(erand48(seed) * free.size()))];
+		x[i] = map.getOriginX() + (cell % map.getWidth() + erand48(seed)) * resolution;
+		y[i] = map.getOriginY() + (cell / map.getWidth() + erand48(seed)) * resolution;
+		theta[i] = (2 * erand48(seed) - 1) * M_PI;
+	}
+	std::fill_n(getWeights(), getParticles(), 1.0 / getParticles());
+}
+
+void MonteCarloLocalization::InitPose(Value x, Value y, Value theta, Value spread, Value spread_theta) {
+	Value mean[3] = { x, y, theta };
+	Value spreads[3] = { spread, spread, spread_theta };
+	Init(0, mean, spreads);
+}
+
+void MonteCarloLocalization::Update(Value dx, Value dy, Value dtheta, const Value *ranges) {
+	translation = std::sqrt(dx * dx + dy * dy);
+	rotation1 = (translation > 1e-6) ? std::atan2(dy, dx) : 0;
+	rotation2 = dtheta - rotation1;
+	std::copy(ranges, ranges + this->ranges.size(), this->ranges.begin());
+	Tick();
+}
+
+void MonteCarloLocalization::GetPose(Value & x, Value & y, Value & theta) {
+	const Value *px = getColumn(0), *py = getColumn(1), *ptheta = getColumn(2);
+	double sum_x = 0, sum_y = 0, sum_cos = 0, sum_sin = 0;
+	int N = getParticles();
+	for (int i = 0; i < N; ++i) {
+		sum_x += px[i];
+		sum_y += py[i];
+		sum_cos += std::cos(ptheta[i]);
+		sum_sin += std::sin(ptheta[i]);
+	}
+	x = sum_x / N;
+	y = sum_y / N;
+	theta = std::atan2(sum_sin, sum_cos);
+}
+
+void MonteCarloLocalization::Transition(int begin, int end) {
+	Value *x = getColumn(0), *y = getColumn(1), *theta = getColumn(2);
+	Value sigma_rotation1 = noise_rotation * std::fabs(rotation1) + noise_translation_rotation * translation;
+	Value sigma_translation = noise_translation * translation +
+			noise_rotation_translation * (std::fabs(rotation1) + std::fabs(rotation2));
+	Value sigma_rotation2 = noise_rotation * std::fabs(rotation2) + noise_translation_rotation * translation;
+	unsigned short *seed = getSeed(0);
+	for (int i = begin; i < end; ++i) {
+		Value r1 = rotation1 + sigma_rotation1 * Normal(seed);
+		Value t = translation + sigma_translation * Normal(seed);
+		Value r2 = rotation2 + sigma_rotation2 * Normal(seed);
+		x[i] += t * std::cos(theta[i] + r1);
+		y[i] += t * std::sin(theta[i] + r1);
+		theta[i] += r1 + r2;
+		if (theta[i] > M_PI) theta[i] -= 2 * M_PI;
+		else if (theta[i] < -M_PI) theta[i] += 2 * M_PI;
+	}
+}
+
+/**
+ * A particle that is not in free space (in an obstacle, in unknown space or outside of the map) gets a
+ * weight of zero. The end point of beam b of particle i is (x + r (c cos a - s sin a), y + r (s cos a + c sin a)) with
+ * (c, s) the cosine and sine of the heading of the particle and a the angle of the beam.
+ */
+void MonteCarloLocalization::Likelihood(int begin, int end) {
+	const Value *x = getColumn(0), *y = getColumn(1), *theta = getColumn(2);
+	double *weights = getWeights();
+	Value c[SCAN_BLOCK], s[SCAN_BLOCK], sum[SCAN_BLOCK];
+	Value best = -std::numeric_limits<Value>::max();
+	for (int p0 = begin; p0 < end; p0 += SCAN_BLOCK) {
+		int n = std::min(SCAN_BLOCK, end - p0);
+		for (int j = 0; j < n; ++j) {
+			c[j] = std::cos(theta[p0 + j]);
+			s[j] = std::sin(theta[p0 + j]);
+			sum[j] = 0;
+		}
+		for (size_t b = 0; b < beam_index.size(); ++b) {
+			Value r = ranges[beam_index[b]];
+			if (!(r > 0) || r >= max_range) continue;
+			Value rc = r * beam_cos[b], rs = r * beam_sin[b];
+			const Value *px = x + p0, *py = y + p0;
+			for (int j = 0; j < n; ++j) {
+				Value ex = px[j] + rc * c[j] - rs * s[j];
+				Value ey = py[j] + rc * s[j] + rs * c[j];
+				sum[j] += map.getLogLikelihood(ex, ey);
+			}
+		}
+		for (int j = 0; j < n; ++j) {
+			if (!map.isFree(x[p0 + j], y[p0 + j])) {
+				log_likelihoods[p0 + j] = -std::numeric_limits<Value>::max();
+				continue;
+			}
+			log_likelihoods[p0 + j] = sum[j];
+			best = std::max(best, sum[j]);
+		}
+	}
+	for (int i = begin; i < end; ++i) {
+		weights[i] = (log_likelihoods[i] > -std::numeric_limits<Value>::max()) ? std::exp(log_likelihoods[i] - best) : 0;
+	}
+}
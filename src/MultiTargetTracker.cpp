@@ -0,0 +1,256 @@
+/**
+ * @brief Tracking of many objects in the same frame with shared per-frame features
+ * @file MultiTargetTracker.cpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+#include <MultiTargetTracker.h>
+
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+using namespace std;
+
+/* **************************************************************************************
+ * Implementation of MultiTargetTracker
+ * **************************************************************************************/
+
+MultiTargetTracker::MultiTargetTracker(): frame(NULL), pool(NULL), interaction_strength(0),
+		interaction_radius(0), occlusion_overlap(0) {
+
+}
+
+MultiTargetTracker::~MultiTargetTracker() {
+	for (size_t i = 0; i < filters.size(); ++i) {
+		delete filters[i];
+	}
+	filters.clear();
+}
+
+void MultiTargetTracker::SetFrame(CImg<DataValue> & frame) {
+	features.Update(frame);
+	this->frame = &frame;
+}
+
+int MultiTargetTracker::AddTarget(CImg<CoordValue> & coord, int particle_count) {
+	return AddTarget(new PositionParticleFilter(), coord, particle_count);
+}
+
+/**
+ * The filter requires what it needs from the shared features before it is initialized, so the reference
+ * histogram is calculated from the same (converted) frame as all other targets.
+ */
+int MultiTargetTracker::AddTarget(PositionParticleFilter *filter, CImg<CoordValue> & coord, int particle_count) {
+	assert (filter != NULL);
+	assert (frame != NULL);
+	filter->SetFrameFeatures(&features);
+	filter->Init(*frame, coord, particle_count);
+	filters.push_back(filter);
+	return filters.size() - 1;
+}
+
+void MultiTargetTracker::RemoveTarget(int index) {
+	assert (index >= 0 && index < (int)filters.size());
+	delete filters[index];
+	filters.erase(filters.begin() + index);
+}
+
+/**
+ * The steps of PositionParticleFilter::Tick for all filters in lockstep, with the likelihoods of all
+ * filters in a single batch.
+ */
+void MultiTargetTracker::Tick(CImg<DataValue> *frame, int subticks) {
+	assert (frame != NULL);
+	assert (subticks > 0);
+	SetFrame(*frame);
+	active.clear();
+	for (size_t i = 0; i < filters.size(); ++i) {
+		if (filters[i]->BeginFrame()) active.push_back(filters[i]);
+	}
+	for (int layer = 0; layer < subticks; ++layer) {
+		for (size_t i = 0; i < active.size(); ++i) {
+			active[i]->Predict(layer, subticks);
+		}
+		Occlusion();
+		Likelihood();
+		if (interaction_strength > 0) {
+			Interact(active);
+		}
+		for (size_t i = 0; i < active.size(); ++i) {
+			active[i]->Correct(layer, subticks);
+		}
+	}
+	for (size_t i = 0; i < active.size(); ++i) {
+		active[i]->EndFrame();
+	}
+}
+
+void MultiTargetTracker::Likelihood() {
+	jobs.clear();
+	for (size_t i = 0; i < active.size(); ++i) {
+		if (active[i]->IsOccluded()) continue;
+		active[i]->BeginBatchLikelihood();
+		int count = active[i]->GetParticleCount();
+		for (int begin = 0; begin < count; begin += LIKELIHOOD_GRAIN) {
+			LikelihoodJob job;
+			job.filter = active[i];
+			job.begin = begin;
+			job.end = std::min(count, begin + LIKELIHOOD_GRAIN);
+			jobs.push_back(job);
+		}
+	}
+	LikelihoodBatch batch(jobs);
+	if (pool != NULL) {
+		pool->Run(batch, jobs.size());
+	} else {
+		batch.Run(0, jobs.size());
+	}
+	for (size_t i = 0; i < active.size(); ++i) {
+		if (!active[i]->IsOccluded()) active[i]->EndBatchLikelihood();
+	}
+#ifdef VERBOSE
+	cout << __func__ << ": Likelihood of " << active.size() << " targets in " << jobs.size() << " jobs" << endl;
+#endif
+}
+
+/**
+ * The predicted regions are the mean estimates after the transition, when all particles count the same.
+ */
+void MultiTargetTracker::Occlusion() {
+	int K = active.size();
+	if (!(occlusion_overlap > 0)) {
+		for (int i = 0; i < K; ++i) active[i]->SetOccluded(false);
+		return;
+	}
+	estimates.resize(K);
+	for (int i = 0; i < K; ++i) {
+		active[i]->GetMeanEstimate(estimates[i]);
+	}
+	for (int i = 0; i < K; ++i) {
+		RegionEstimate & a = estimates[i];
+		Value area = Value(a.x1 - a.x0 + 1) * (a.y1 - a.y0 + 1);
+		bool occluded = false;
+		for (int j = 0; j < K && !occluded; ++j) {
+			RegionEstimate & b = estimates[j];
+			if (j == i || b.y1 <= a.y1) continue;
+			int w = std::min(a.x1, b.x1) - std::max(a.x0, b.x0) + 1;
+			int h = std::min(a.y1, b.y1) - std::max(a.y0, b.y0) + 1;
+			if (w > 0 && h > 0 && Value(w) * h >= occlusion_overlap * area) occluded = true;
+		}
+		if (occluded != active[i]->IsOccluded()) {
+			cout << "Target at [" << a.x << ',' << a.y << "] is " << (occluded ? "occluded" : "visible again") << endl;
+		}
+		active[i]->SetOccluded(occluded);
+	}
+}
+
+/**
+ * Every target is first added to a grid of all targets. Then, target by target, its own particles are
+ * added to a separate grid, so the others follow by subtracting them. Only the cells that the target
+ * uses are cleared again. Occluded targets do not take part.
+ */
+void MultiTargetTracker::Interact(std::vector<PositionParticleFilter*> & targets) {
+	CImg<DataValue> *img = features.getImage();
+	assert (img != NULL);
+	int K = targets.size();
+
+	// the particle positions of all targets, and the radius
+	offsets.assign(1, 0);
+	Value width_sum = 0;
+	int interacting = 0;
+	for (int i = 0; i < K; ++i) {
+		int count = targets[i]->IsOccluded() ? 0 : targets[i]->GetParticleCount();
+		offsets.push_back(offsets.back() + count);
+		if (!count) continue;
+		interacting++;
+		if (!(interaction_radius > 0)) {
+			RegionEstimate estimate;
+			targets[i]->GetMeanEstimate(estimate);
+			width_sum += estimate.x1 - estimate.x0 + 1;
+		}
+	}
+	if (interacting < 2) return;
+	positions_x.resize(offsets.back());
+	positions_y.resize(offsets.back());
+	for (int i = 0; i < K; ++i) {
+		if (offsets[i+1] > offsets[i]) targets[i]->GetPositions(&positions_x[offsets[i]], &positions_y[offsets[i]]);
+	}
+	Value r = (interaction_radius > 0) ? interaction_radius : std::max(Value(1), width_sum / interacting);
+	Value inv_r2 = 1 / (r * r);
+	int columns = std::max(1, (int)std::ceil(img->width() / r));
+	int rows = std::max(1, (int)std::ceil(img->height() / r));
+	int cells = columns * rows;
+
+	grid_mass.assign(cells, 0);
+	grid_x.assign(cells, 0);
+	grid_y.assign(cells, 0);
+	own_mass.assign(cells, 0);
+	own_x.assign(cells, 0);
+	own_y.assign(cells, 0);
+	cell_of.resize(offsets.back());
+	for (int i = 0; i < K; ++i) {
+		int count = offsets[i+1] - offsets[i];
+		for (int p = offsets[i]; p < offsets[i+1]; ++p) {
+			int cx = std::min(columns - 1, std::max(0, (int)(positions_x[p] / r)));
+			int cy = std::min(rows - 1, std::max(0, (int)(positions_y[p] / r)));
+			int c = cy * columns + cx;
+			cell_of[p] = c;
+			grid_mass[c] += Value(1) / count;
+			grid_x[c] += positions_x[p] / count;
+			grid_y[c] += positions_y[p] / count;
+		}
+	}
+
+	for (int i = 0; i < K; ++i) {
+		int count = offsets[i+1] - offsets[i];
+		if (!count) continue;
+		used.clear();
+		for (int p = offsets[i]; p < offsets[i+1]; ++p) {
+			int c = cell_of[p];
+			if (own_mass[c] == 0) used.push_back(c);
+			own_mass[c] += Value(1) / count;
+			own_x[c] += positions_x[p] / count;
+			own_y[c] += positions_y[p] / count;
+		}
+		factors.resize(count);
+		for (int p = offsets[i]; p < offsets[i+1]; ++p) {
+			int cx = cell_of[p] % columns, cy = cell_of[p] / columns;
+			Value s = 0;
+			for (int y = std::max(0, cy - 1); y <= std::min(rows - 1, cy + 1); ++y) {
+				for (int x = std::max(0, cx - 1); x <= std::min(columns - 1, cx + 1); ++x) {
+					int c = y * columns + x;
+					Value mass = grid_mass[c] - own_mass[c];
+					if (mass < 1e-6) continue;
+					Value dx = (grid_x[c] - own_x[c]) / mass - positions_x[p];
+					Value dy = (grid_y[c] - own_y[c]) / mass - positions_y[p];
+					Value d2 = (dx * dx + dy * dy) * inv_r2;
+					if (d2 < 1) s += mass * (1 - d2);
+				}
+			}
+			factors[p - offsets[i]] = std::exp(-interaction_strength * s);
+		}
+		targets[i]->ScaleWeights(&factors[0]);
+		for (size_t u = 0; u < used.size(); ++u) {
+			own_mass[used[u]] = own_x[used[u]] = own_y[used[u]] = 0;
+		}
+	}
+}
@@ -0,0 +1,149 @@
+/**
+ * @brief Occupancy grid map with a precomputed likelihood field for range sensors
+ * @file OccupancyGrid.cpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+#include <OccupancyGrid.h>
+
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+using namespace std;
+
+//! Squared distance for cells without any occupied cell in their row or column (yet)
+static const Value far_away = 1e20;
+
+/* **************************************************************************************
+ * Implementation of OccupancyGrid
+ * **************************************************************************************/
+
+OccupancyGrid::OccupancyGrid(int width, int height, Value resolution, Value origin_x, Value origin_y):
+		width(width), height(height), resolution(resolution), origin_x(origin_x), origin_y(origin_y) {
+	assert (width > 0 && height > 0 && resolution > 0);
+	inv_resolution = 1 / resolution;
+	cells.assign(width * height, CS_FREE);
+	outside = 0;
+}
+
+OccupancyGrid::~OccupancyGrid() {
+
+}
+
+void OccupancyGrid::Load(CImg<DataValue> & img, int threshold) {
+	width = img._width;
+	height = img._height;
+	cells.assign(width * height, CS_FREE);
+	distances.clear();
+	field.clear();
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			int sum = 0;
+			for (int c = 0; c < (int)img._spectrum; ++c) sum += img(x, y, 0, c);
+			if (sum < threshold * (int)img._spectrum) setCell(x, y, CS_OCCUPIED);
+		}
+	}
+}
+
+/**
+ * The squared distance transform is separable: first along the columns, then along the rows of the
+ * result. Unknown cells count as free, so a beam that ends in unknown space is not rewarded.
+ */
+void OccupancyGrid::CalcLikelihoodField(Value sigma, Value z_hit, Value z_random, Value max_range) {
+	assert (sigma > 0 && max_range > 0);
+	int n = width * height;
+	int size = std::max(width, height);
+	std::vector<Value> f(n), d(size), z(size + 1);
+	std::vector<int> v(size);
+	for (int i = 0; i < n; ++i) {
+		f[i] = (cells[i] == CS_OCCUPIED) ? 0 : far_away;
+	}
+	for (int x = 0; x < width; ++x) {
+		Transform(&f[x], height, width, &d[0], &v[0], &z[0]);
+		for (int y = 0; y < height; ++y) f[y * width + x] = d[y];
+	}
+	for (int y = 0; y < height; ++y) {
+		Transform(&f[y * width], width, 1, &d[0], &v[0], &z[0]);
+		std::copy(d.begin(), d.begin() + width, f.begin() + y * width);
+	}
+
+	distances.resize(n);
+	field.resize(n);
+	Value random = z_random / max_range;
+	Value normalization = z_hit / (sigma * std::sqrt(2 * M_PI));
+	Value inv_two_variance = 1 / (2 * sigma * sigma);
+	for (int i = 0; i < n; ++i) {
+		Value distance = (f[i] >= far_away) ? max_range : std::sqrt(f[i]) * resolution;
+		distances[i] = distance;
+		field[i] = std::log(normalization * std::exp(-distance * distance * inv_two_variance) + random);
+	}
+	outside = std::log(random);
+}
+
+void OccupancyGrid::GetFreeCells(std::vector<int> & free) {
+	free.clear();
+	for (int i = 0; i < width * height; ++i) {
+		if (cells[i] == CS_FREE) free.push_back(i);
+	}
+}
+
+/**
+ * The lower envelope of the parabolas (q - p)^2 + f(p), see Felzenszwalb and Huttenlocher, "Distance
+ * transforms of sampled functions". The vertices of the envelope are in v, the boundaries between them
+ * in z.
+ */
+void OccupancyGrid::Transform(Value *f, int n, int stride, Value *d, int *v, Value *z) {
+	int k = 0;
+	v[0] = -1;
+	// skip leading cells that are far away, they do not form a parabola of their own
+	for (int q = 0; q < n; ++q) {
+		if (f[q * stride] < far_away) {
+			v[0] = q;
+			break;
+		}
+	}
+	if (v[0] < 0) {
+		for (int q = 0; q < n; ++q) d[q] = far_away;
+		return;
+	}
+	z[0] = -far_away;
+	z[1] = far_away;
+	for (int q = v[0] + 1; q < n; ++q) {
+		Value fq = f[q * stride];
+		if (fq >= far_away) continue;
+		Value s = ((fq + Value(q) * q) - (f[v[k] * stride] + Value(v[k]) * v[k])) / (2 * (q - v[k]));
+		while (s <= z[k]) {
+			k--;
+			s = ((fq + Value(q) * q) - (f[v[k] * stride] + Value(v[k]) * v[k])) / (2 * (q - v[k]));
+		}
+		k++;
+		v[k] = q;
+		z[k] = s;
+		z[k + 1] = far_away;
+	}
+	k = 0;
+	for (int q = 0; q < n; ++q) {
+		while (z[k + 1] < q) k++;
+		Value dq = q - v[k];
+		d[q] = dq * dq + f[v[k] * stride];
+	}
+}
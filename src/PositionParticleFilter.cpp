@@ -30,18 +30,59 @@ using namespace dobots;
  * Implementation of PositionParticleFilter
  * **************************************************************************************/
 
-PositionParticleFilter::PositionParticleFilter() {
-	bins = 16;
+PositionParticleFilter::PositionParticleFilter(): bins(16), features(&own_features), halton(3),
+		random_number_generator(dobots::autoregression_seed), normal_dist(0, 1),
+		epsilon(random_number_generator, normal_dist) {
 	seed = 234789;
+	kernel_layers = 0;
+	min_likelihood = 0;
+	model_learning_rate = 0;
+	model_min_likelihood = 0.01;
+	model_max_drift = 0.5;
+	min_coverage = 0;
+	background_likelihood = 1e-6;
+	mean_shift_iterations = 0;
+	mean_shift_particles = 0;
+	annealing_rate = 0;
+	annealing_noise = 0.5;
+	likelihood_exponent = 20.0;
+	transition_noise = 1.0;
+	diffusion_only = false;
+	mode = TM_PARTICLES;
+	mode_frames = 0;
+	mode_max_spread = 3.0;
+	mode_min_ess = 0.3;
+	mode_min_likelihood = 0.1;
+	mode_mean_shift_iterations = 5;
+	unimodal_frames = 0;
+	quasi_monte_carlo = false;
+	systematic_resampling = false;
+	qmc_tick = 0;
+	auxiliary.bins = 0;
+	auxiliary.threshold = 0;
+	auxiliary.histogram = NULL;
+	auxiliary.evaluated = auxiliary.rejected = 0;
+	regularization = 0;
+	occluded = false;
+	smoothing = false;
+	offline_smoothing = false;
+	in_first_stage = false;
+	part_columns = part_rows = 1;
 	auto_coeff.clear();
 	auto_coeff.push_back(2.0);
 	auto_coeff.push_back(-1.0);
+	diffusion_coeff.assign(1, Value(1));
 	srand48(seed);
 	img = NULL;
+	integral_histogram = features->Require(bins);
+	annealed = look_ahead = unimodal = false;
 }
 
 PositionParticleFilter::~PositionParticleFilter() {
-
+	ClearCascade();
+	SetAuxiliary(false);
+	SetForegroundGate(0);
+	features->Release(bins);
 }
 
 /**
@@ -49,22 +90,124 @@ PositionParticleFilter::~PositionParticleFilter() {
  * - transition according to a certain motion model
  * - observing the likelihood of the object being at the translated position (results in a weight)
  * - resample according to that likelihood (given by the weight)
+ * The frame is converted to the requested color space and its integral histogram is calculated
+ * only once, all subticks use the result. With shared frame features (see SetFrameFeatures) this
+ * is left to the owner of the features. If the cloud has been unimodal for a while (see
+ * SetModeSwitch) a single hypothesis is tracked instead, in which case subticks are ignored. With a
+ * worker pool (see SetWorkerPool) the particles are resampled systematically and in parallel.
  * @param img_frame			the image with the entitie(s) to be tracked
  * @param subticks			the number of times this same image needs to be used
  */
 void PositionParticleFilter::Tick(CImg<DataValue> *img_frame, int subticks)  {
-	img = img_frame;
+	assert (img_frame != NULL);
+	if (features == &own_features) {
+		features->Update(*img_frame);
+	}
 	assert (subticks > 0);
+	if (!BeginFrame()) return;
 	for (int i = 0; i < subticks; ++i) {
-		cout << "Transition all particles" << endl;
-		Transition();
+		Predict(i, subticks);
 		cout << "Likelihood for all particles" << endl;
 		Likelihood();
-		cout << "Resample all particles" << endl;
-		Resample();
+		Correct(i, subticks);
+	}
+	EndFrame();
+}
+
+/**
+ * Pick up the frame from the frame features. A single hypothesis is tracked right away. That also holds for
+ * the frame in which it degrades: the particles then already have the state of this frame, and the cloud is
+ * only used from the next frame on, otherwise they would move twice.
+ */
+bool PositionParticleFilter::BeginFrame() {
+	img = features->getImage();
+	assert (img != NULL);
+	unimodal = false;
+	if (mode == TM_SINGLE) {
+		TickSingle();
+		return false;
+	}
+	cout << "Mode: particles" << endl;
+	return true;
+}
+
+/**
+ * Everything before the likelihood: the annealing layer, the first stage of the auxiliary particle filter,
+ * the transition and mean shift.
+ */
+void PositionParticleFilter::Predict(int layer, int layers) {
+	annealed = (annealing_rate > 0) && (layers > 1);
+	if (annealed) {
+		likelihood_exponent = 20.0 * std::pow(annealing_rate, layers - 1 - layer);
+		transition_noise = std::pow(annealing_noise, layer);
+		diffusion_only = (layer > 0);
+		cout << "Annealing layer " << layer << " with exponent " << likelihood_exponent << endl;
+	}
+	// the look-ahead only makes sense before the motion model, not in later annealing layers
+	look_ahead = (auxiliary.histogram != NULL) && (layer == 0 || !annealed);
+	if (look_ahead) {
+		cout << "Auxiliary first stage" << endl;
+		FirstStage();
+	}
+	cout << "Transition all particles" << endl;
+	Transition();
+	if (mean_shift_iterations > 0) {
+		cout << "Mean-shift refinement" << endl;
+		MeanShift();
+	}
+}
+
+/**
+ * Everything after the likelihood: the weights of the auxiliary particle filter, the model update, and
+ * resampling.
+ */
+void PositionParticleFilter::Correct(int layer, int layers) {
+	if (occluded) {
+		cout << "Occluded, ignore the likelihood" << endl;
+		std::vector<Particle<ParticleState>* >::iterator p;
+		for (p = getParticles().begin(); p != getParticles().end(); ++p) {
+			(*p)->setWeight(1);
+		}
+	} else if (look_ahead) {
+		// the particles have been selected with the first stage, compensate for that
+		std::vector<Particle<ParticleState>* >::iterator p;
+		for (p = getParticles().begin(); p != getParticles().end(); ++p) {
+			(*p)->setWeight((*p)->getWeight() / (*p)->getState()->first_stage);
+		}
+	}
+	// only learn from the likelihood with the final (sharpest) exponent
+	if (model_learning_rate > 0 && !occluded && (!annealed || layer == layers - 1)) {
+		UpdateModel();
+	}
+	cout << "Resample all particles" << endl;
+	if (regularization > 0) {
+		Regularize();
+	} else if (GetWorkerPool() != NULL) {
+		ResampleParallel(quasi_monte_carlo ? halton.get(++qmc_tick, 2) : drand48());
+	} else {
+		ResampleSerial();
+	}
+	if (mode_frames > 0 && !occluded && layer == layers - 1) {
+		unimodal = IsUnimodal();
 	}
 }
 
+void PositionParticleFilter::EndFrame() {
+	if (unimodal) {
+		// after resampling the copies of the MAP particle are in front, continue with the first, of which the
+		// whole history is moved to the mode, so its velocity stays the same
+		cout << "Switch to single hypothesis at [" << mode_x << ',' << mode_y << ']' << endl;
+		ParticleState *state = getParticles().front()->getState();
+		Value dx = mode_x - state->x[0], dy = mode_y - state->y[0];
+		for (size_t j = 0; j < state->x.size(); ++j) state->x[j] += dx;
+		for (size_t j = 0; j < state->y.size(); ++j) state->y[j] += dy;
+		mode = TM_SINGLE;
+	}
+	likelihood_exponent = 20.0;
+	transition_noise = 1.0;
+	diffusion_only = false;
+}
+
 /**
  * Initialise the particle filter.
  */
@@ -79,6 +222,12 @@ void PositionParticleFilter::Init(NormalizedHistogramValues &tracked_object_hist
 	cout << "Width*height=" << width << '*' << height << endl;
 
 	this->tracked_object_histogram = tracked_object_histogram;
+	initial_object_histogram = tracked_object_histogram;
+	UpdateCascadeReferences();
+	mode = TM_PARTICLES;
+	unimodal_frames = 0;
+	smoother.Clear();
+	offline_smoother.Clear();
 
 	// generate duplicates of particles
 	for (int i = 0; i < particle_count; ++i) {
@@ -102,6 +251,28 @@ void PositionParticleFilter::Init(NormalizedHistogramValues &tracked_object_hist
 	ASSERT_EQUAL(getParticles().size(), particle_count);
 }
 
+/**
+ * Calculate the reference histogram(s) from the region in the frame itself. Regions are handled
+ * the same as in Likelihood, so the width and height are measured between the corners. Shared frame
+ * features should have been updated with the frame already.
+ */
+void PositionParticleFilter::Init(CImg<DataValue> &frame, CImg<CoordValue> &coord, int particle_count) {
+	if (features == &own_features) {
+		features->ResetBackground();
+		features->Update(frame);
+	}
+	img = features->getImage();
+	assert (img != NULL);
+
+	int width = coord(3) - coord(0);
+	int height = coord(4) - coord(1);
+	Value x = coord(0) + width / 2;
+	Value y = coord(1) + height / 2;
+	NormalizedHistogramValues reference;
+	GetHistogram(*integral_histogram, x - width/Value(2), y - height/Value(2), x + width/Value(2), y + height/Value(2), reference);
+	Init(reference, coord, particle_count);
+}
+
 /**
  * Transition of all particles following a certain motion model. Due to the fact there is
  * no multiplication or removal in the number of particles at this moment, we can safely
@@ -109,6 +280,18 @@ void PositionParticleFilter::Init(NormalizedHistogramValues &tracked_object_hist
  */
 void PositionParticleFilter::Transition() {
 	std::vector<Particle<ParticleState>* >::iterator i;
+	if (quasi_monte_carlo) {
+		// a fresh shift makes the point set an unbiased sample, point 0 is no longer special
+		halton.setShift(0, drand48());
+		halton.setShift(1, drand48());
+		unsigned long k = 0;
+		for (i = getParticles().begin(); i != getParticles().end(); ++i, ++k) {
+			ParticleState *state = (*i)->getState();
+			assert (state != NULL);
+			Transition(*state, halton.getNormal(k, 0), halton.getNormal(k, 1));
+		}
+		return;
+	}
 	for (i = getParticles().begin(); i != getParticles().end(); ++i) {
 		ParticleState *state = (*i)->getState();
 		assert (state != NULL);
@@ -119,28 +302,51 @@ void PositionParticleFilter::Transition() {
 }
 
 void PositionParticleFilter::Likelihood() {
-	std::vector<Particle<ParticleState>* >::iterator i;
-	for (i = getParticles().begin(); i != getParticles().end(); ++i) {
-		ParticleState *state = (*i)->getState();
-		assert (state != NULL);
-		state->likelihood = Likelihood(*state);
-		(*i)->setWeight(state->likelihood);
-	}
+	BatchLikelihood();
 
 	// log for the user
-	std::sort(getParticles().begin(), getParticles().end(), comp_particles<ParticleState>);
-	int max = 10;
+	RegionEstimate top[10];
+	int count = GetTopEstimates(top, 10);
 	cout << "Likelihoods: ";
-	for (i = getParticles().begin(); i != getParticles().end(); ++i) {
-		ParticleState *state = (*i)->getState();
-		cout << '[' << state->getId() << ':' << state->likelihood << "] ";
-		if (--max == 0) break;
+	for (int k = 0; k < count; ++k) {
+		cout << '[' << top[k].x << ',' << top[k].y << ':' << top[k].likelihood << "] ";
 	}
 	cout << endl;
+	for (size_t s = 0; s < cascade.size(); ++s) {
+		CascadeStage & stage = cascade[s];
+		cout << "Cascade stage " << s << " (" << stage.bins << " bins): rejected " << stage.rejected << " of ";
+		cout << stage.evaluated << " particles" << endl;
+	}
 
 //	ASSERT_EQUAL(getParticles().size(), particle_count);
 }
 
+/**
+ * The weight is the log-likelihood itself, the likelihood is kept with the state. States are only read
+ * from the frame features, so batches can be evaluated concurrently (see MultiTargetTracker).
+ */
+void PositionParticleFilter::LogLikelihood(ParticleState * const *states, int count, double *log_weights) {
+	for (int i = 0; i < count; ++i) {
+		log_weights[i] = LogLikelihood(*states[i]);
+		states[i]->likelihood = std::exp(log_weights[i]);
+	}
+}
+
+void PositionParticleFilter::GetPositions(Value *x, Value *y) {
+	std::vector<Particle<ParticleState>* > & particles = getParticles();
+	for (size_t i = 0; i < particles.size(); ++i) {
+		x[i] = particles[i]->getState()->x[0];
+		y[i] = particles[i]->getState()->y[0];
+	}
+}
+
+void PositionParticleFilter::ScaleWeights(const Value *factors) {
+	std::vector<Particle<ParticleState>* > & particles = getParticles();
+	for (size_t i = 0; i < particles.size(); ++i) {
+		particles[i]->setWeight(particles[i]->getWeight() * factors[i]);
+	}
+}
+
 /**
  * Return the particle coordinates for display.
  */
@@ -154,8 +360,7 @@ void PositionParticleFilter::GetParticleCoordinates(std::vector<CImg<CoordValue>
 		ParticleState *state = (*i)->getState();
 		assert (state != NULL);
 		assert (state->getId());
-		std::string msg; msg = "state is empty " + state->getId();
-		if(state->x.empty()) cout << msg << endl;
+		if (state->x.empty()) cout << "state is empty " << state->getId() << endl;
 		assert (!state->x.empty());
 		assert (!state->y.empty());
 		assert (!state->scale.empty());
@@ -172,6 +377,87 @@ void PositionParticleFilter::GetParticleCoordinates(std::vector<CImg<CoordValue>
 	}
 }
 
+/**
+ * The position is estimated, the rest of the state (history, size) follows from it.
+ */
+void PositionParticleFilter::GetColumns(ParticleState & state, double *values) {
+	values[0] = state.x[0];
+	values[1] = state.y[0];
+}
+
+/**
+ * Helper function for a heap of estimates with the lowest likelihood on top
+ */
+static bool comp_estimates(const RegionEstimate & e0, const RegionEstimate & e1) {
+	return e0.likelihood > e1.likelihood;
+}
+
+/**
+ * The first k particles fill the heap. Every next particle that beats the worst estimate on top replaces it.
+ * Sorting the heap at the end puts the best estimate first.
+ */
+int PositionParticleFilter::GetTopEstimates(RegionEstimate *estimates, int k) {
+	if (k <= 0) return 0;
+	int count = 0;
+	std::vector<Particle<ParticleState>* >::iterator i;
+	for (i = getParticles().begin(); i != getParticles().end(); ++i) {
+		if (count == k) {
+			if ((*i)->getState()->likelihood <= estimates[0].likelihood) continue;
+			std::pop_heap(estimates, estimates + count, comp_estimates);
+			count--;
+		}
+		GetRegionEstimate(**i, estimates[count++]);
+		std::push_heap(estimates, estimates + count, comp_estimates);
+	}
+	std::sort_heap(estimates, estimates + count, comp_estimates);
+	return count;
+}
+
+bool PositionParticleFilter::GetMapEstimate(RegionEstimate & estimate) {
+	if (getParticles().empty()) return false;
+	std::vector<Particle<ParticleState>* >::iterator i, best = getParticles().begin();
+	for (i = getParticles().begin() + 1; i != getParticles().end(); ++i) {
+		if ((*i)->getState()->likelihood > (*best)->getState()->likelihood) best = i;
+	}
+	GetRegionEstimate(**best, estimate);
+	return true;
+}
+
+bool PositionParticleFilter::GetMeanEstimate(RegionEstimate & estimate) {
+	if (getParticles().empty()) return false;
+	double sum = 0;
+	std::vector<Particle<ParticleState>* >::iterator i;
+	for (i = getParticles().begin(); i != getParticles().end(); ++i) {
+		sum += (*i)->getWeight();
+	}
+	bool uniform = (sum <= 0);
+	double sum_w = 0, sum_x = 0, sum_y = 0, sum_likelihood = 0;
+	for (i = getParticles().begin(); i != getParticles().end(); ++i) {
+		ParticleState *state = (*i)->getState();
+		double w = uniform ? 1.0 : (*i)->getWeight();
+		sum_w += w;
+		sum_x += w * state->x[0];
+		sum_y += w * state->y[0];
+		sum_likelihood += w * state->likelihood;
+	}
+	estimate.x = sum_x / sum_w;
+	estimate.y = sum_y / sum_w;
+	estimate.likelihood = sum_likelihood / sum_w;
+	estimate.weight = sum;
+	GetRegion(*getParticles().front()->getState(), estimate.x, estimate.y, estimate.x0, estimate.y0,
+			estimate.x1, estimate.y1);
+	return true;
+}
+
+void PositionParticleFilter::GetRegionEstimate(Particle<ParticleState> & particle, RegionEstimate & estimate) {
+	ParticleState & state = *particle.getState();
+	estimate.x = state.x[0];
+	estimate.y = state.y[0];
+	estimate.likelihood = state.likelihood;
+	estimate.weight = particle.getWeight();
+	GetRegion(state, estimate.x0, estimate.y0, estimate.x1, estimate.y1);
+}
+
 /**
  * Normal state of affairs is to use an autoregressive model to estimate where an
  * object will be next. There are however many different autoregressive models in use,
@@ -201,8 +487,17 @@ void PositionParticleFilter::Transition(ParticleState &oldp) {
 
 //#define OVERWRITE
 
-	int xn = dobots::predict(oldp.x.begin(), oldp.x.end(), auto_coeff.begin(), 0.0, 1.0);
-	int yn = dobots::predict(oldp.y.begin(), oldp.y.end(), auto_coeff.begin(), 0.0, 1.0);
+	if (diffusion_only) {
+		// later layers of an annealed tick are on the same frame, so only diffuse the current position
+		Value x = dobots::predict(oldp.x.begin(), oldp.x.begin() + 1, diffusion_coeff.begin(), Value(0), transition_noise);
+		Value y = dobots::predict(oldp.y.begin(), oldp.y.begin() + 1, diffusion_coeff.begin(), Value(0), transition_noise);
+		oldp.x[0] = std::max(Value(0), std::min(Value(img->_width-1), x));
+		oldp.y[0] = std::max(Value(0), std::min(Value(img->_height-1), y));
+		return;
+	}
+
+	int xn = dobots::predict(oldp.x.begin(), oldp.x.end(), auto_coeff.begin(), 0.0, (double)transition_noise);
+	int yn = dobots::predict(oldp.y.begin(), oldp.y.end(), auto_coeff.begin(), 0.0, (double)transition_noise);
 	Value scale = dobots::predict(oldp.scale.begin(), oldp.scale.end(), auto_coeff.begin(), 0.0, 0.001);
 
 	xn = std::max(0, std::min((int)img->_width-1, xn));
@@ -234,6 +529,31 @@ void PositionParticleFilter::Transition(ParticleState &oldp) {
 //	cout << "Transition particle " << oldp << endl;
 }
 
+/**
+ * The same autoregressive model (or diffusion in later annealing layers), with the standard normal noise
+ * given by the caller instead of drawn by predict.
+ */
+void PositionParticleFilter::Transition(ParticleState &oldp, Value noise_x, Value noise_y) {
+	Value xn, yn;
+	if (diffusion_only) {
+		xn = oldp.x[0] + transition_noise * noise_x;
+		yn = oldp.y[0] + transition_noise * noise_y;
+	} else {
+		xn = dobots::predict_mean(oldp.x.begin(), oldp.x.end(), auto_coeff.begin(), Value(0)) + transition_noise * noise_x;
+		yn = dobots::predict_mean(oldp.y.begin(), oldp.y.end(), auto_coeff.begin(), Value(0)) + transition_noise * noise_y;
+	}
+	xn = std::max(Value(0), std::min(Value(img->_width-1), xn));
+	yn = std::max(Value(0), std::min(Value(img->_height-1), yn));
+	if (diffusion_only) {
+		oldp.x[0] = xn;
+		oldp.y[0] = yn;
+		return;
+	}
+	dobots::pushpop(oldp.x.begin(), oldp.x.end(), xn);
+	dobots::pushpop(oldp.y.begin(), oldp.y.end(), yn);
+	dobots::pushpop(oldp.scale.begin(), oldp.scale.end(), Value(1));
+}
+
 /**
  * The likelihood of a player at all locations in the image using a given region size. The result is
  * written back in the form of a picture with colour values.
@@ -282,48 +602,585 @@ void PositionParticleFilter::GetLikelihoods(CImg<DataValue> & result, RegionSize
 	}
 }
 
+float PositionParticleFilter::Likelihood(ParticleState & state) {
+	return std::exp(LogLikelihood(state));
+}
+
 /**
- * Calculate the likelihood of a player and the state indicated by the parameter
+ * Calculate the log-likelihood of a player and the state indicated by the parameter
  * "state" which contains an x and y position, a width and a height. This is used
  * to define a rectangle for which a histogram is matched against the reference
  * histogram of the object that is tracked.
+ *
+ * The histogram of the rectangle is obtained from the integral histogram of the frame, which
+ * costs a few lookups per bin instead of a crop plus a pass over all pixels in the rectangle.
+ * With a foreground gate, a rectangle that hardly covers any foreground does not get a
+ * histogram at all. The logarithm is returned as is, without an exponential, so a rectangle far
+ * from the object still has a weight relative to the others.
  * @param state			the state of the particle (position, width, height)
- * @return				conceptual "distance" to the reference (tracked) object
+ * @return				minus the scaled distance to the reference (tracked) object
  */
-float PositionParticleFilter::Likelihood(ParticleState & state) {
+Value PositionParticleFilter::LogLikelihood(ParticleState & state) {
 	assert (img != NULL);
-	CImg <CoordValue> coord(6);
-	float scale = state.scale.front();
-	scale = 1;
-	coord._data[0] = state.x[0] - scale * state.width/2;
-	coord._data[1] = state.y[0] - scale * state.height/2;
-	coord._data[3] = state.x[0] + scale * state.width/2;
-	coord._data[4] = state.y[0] + scale * state.height/2;
-	CImg <DataValue> img_selection = img->get_crop(coord._data[0], coord._data[1], coord._data[3], coord._data[4]);
-	DataFrames frames;
-	frames.clear();
-	pDataMatrix data = img_selection._data;
-	frames.push_back(data);
-
-	Histogram histogram(bins, img_selection._width, img_selection._height);
-#ifdef VERBOSE
-	cout << __func__ << ": Add data for histograms" << endl;
-#endif
-	assert (frames.size() == 1);
-	histogram.calcProbabilities(frames);
+	CoordValue x0, y0, x1, y1;
+	GetRegion(state, x0, y0, x1, y1);
+	// the model needs at least one frame after initialization to have a foreground
+	if (min_coverage > 0 && features->getBackgroundModel().getFrameCount() > 1) {
+		if (features->getBackgroundModel().getCoverage(x0, y0, x1, y1) < min_coverage) {
+			return std::log(background_likelihood);
+		}
+	}
+	NormalizedHistogramValues result;
+	// the distance at which the likelihood becomes negligible
+	Value cutoff = (min_likelihood > 0) ? -std::log(min_likelihood) / likelihood_exponent : 0;
+	for (size_t s = 0; s < cascade.size(); ++s) {
+		CascadeStage & stage = cascade[s];
+		__sync_fetch_and_add(&stage.evaluated, 1);
+		GetHistogram(*stage.histogram, x0, y0, x1, y1, result);
+		Value log_likelihood = -likelihood_exponent * Distance(stage.reference, result, stage.bins, cutoff);
+		if (log_likelihood < stage.log_threshold) {
+			__sync_fetch_and_add(&stage.rejected, 1);
+			return log_likelihood;
+		}
+	}
+
+	GetHistogram(*integral_histogram, x0, y0, x1, y1, result);
 
 #ifdef VERBOSE
-	cout << __func__ << ": Get normalized probabilities" << endl;
+	cout << __func__ << ": Calculate distance to histogram of the to-be-tracked object" << endl;
 #endif
+
+	return -likelihood_exponent * Distance(tracked_object_histogram, result, bins, cutoff);
+}
+
+/**
+ * The squared Hellinger distance between the histograms, averaged over all parts. With a cutoff the evaluation
+ * is abandoned as soon as the mean distance is certain to be above it. Every part contributes a non-negative
+ * distance, so the budget for a part is what is left of the total over all parts.
+ */
+Value PositionParticleFilter::Distance(NormalizedHistogramValues & reference, NormalizedHistogramValues & observed,
+		int bins, Value cutoff) {
+	ASSERT_EQUAL(reference.size(), observed.size());
+	int parts = part_columns * part_rows;
+	Value dist = 0;
+	if (cutoff > 0) {
+		Value budget = parts * cutoff;
+		for (int p = 0; p < parts; ++p) {
+			NormalizedHistogramValues::iterator ref = reference.begin() + p * bins;
+			NormalizedHistogramValues::iterator obs = observed.begin() + p * bins;
+			dist += dobots::distance_bounded<Value>(ref, ref + bins, obs, obs + bins, dobots::DM_SQUARED_HELLINGER,
+					budget - dist);
+			if (dist > budget) break;
+		}
+		return dist / parts;
+	}
+	for (int p = 0; p < parts; ++p) {
+		NormalizedHistogramValues::iterator ref = reference.begin() + p * bins;
+		NormalizedHistogramValues::iterator obs = observed.begin() + p * bins;
+		dist += dobots::distance<Value>(ref, ref + bins, obs, obs + bins, dobots::DM_SQUARED_HELLINGER);
+	}
+	return dist / parts;
+}
+
+/**
+ * The rectangle around the position of a particle, scaled by its scale factor (which is at the moment
+ * fixed to one).
+ */
+void PositionParticleFilter::GetRegion(ParticleState & state, CoordValue & x0, CoordValue & y0,
+		CoordValue & x1, CoordValue & y1) {
+	GetRegion(state, state.x[0], state.y[0], x0, y0, x1, y1);
+}
+
+void PositionParticleFilter::GetRegion(ParticleState & state, Value x, Value y, CoordValue & x0, CoordValue & y0,
+		CoordValue & x1, CoordValue & y1) {
+	float scale = state.scale.front();
+	scale = 1;
+	x0 = x - scale * state.width/2;
+	y0 = y - scale * state.height/2;
+	x1 = x + scale * state.width/2;
+	y1 = y + scale * state.height/2;
+}
+
+/**
+ * The expected position of the autoregressive model, see Transition.
+ */
+void PositionParticleFilter::PredictMean(ParticleState & state, Value & x, Value & y) {
+	x = dobots::predict_mean(state.x.begin(), state.x.end(), auto_coeff.begin(), Value(0));
+	y = dobots::predict_mean(state.y.begin(), state.y.end(), auto_coeff.begin(), Value(0));
+}
+
+/**
+ * The first stage of the auxiliary particle filter (Pitt and Shephard). Every particle is weighted by a cheap
+ * likelihood at the mean of its prediction: a coarse histogram at the position the motion model expects,
+ * without noise. Resampling on these weights keeps the particles that are likely to end up somewhere good,
+ * before effort is spent on propagating them. The first-stage likelihood stays with the (copies of the)
+ * particle, the final weight is the full likelihood divided by it.
+ */
+void PositionParticleFilter::FirstStage() {
+	std::vector<Particle<ParticleState>* >::iterator i;
 	NormalizedHistogramValues result;
-	histogram.getProbabilities(result);
+	for (i = getParticles().begin(); i != getParticles().end(); ++i) {
+		ParticleState *state = (*i)->getState();
+		Value x, y;
+		PredictMean(*state, x, y);
+		CoordValue x0, y0, x1, y1;
+		GetRegion(*state, x, y, x0, y0, x1, y1);
+		GetHistogram(*auxiliary.histogram, x0, y0, x1, y1, result);
+		state->first_stage = std::exp(-likelihood_exponent * Distance(auxiliary.reference, result, auxiliary.bins));
+		(*i)->setWeight(state->first_stage);
+	}
+	in_first_stage = true;
+	ResampleSerial();
+	in_first_stage = false;
+}
+
+void PositionParticleFilter::SetAuxiliary(bool enable, int bins) {
+	if (auxiliary.histogram != NULL) features->Release(auxiliary.bins);
+	auxiliary.histogram = NULL;
+	if (!enable) return;
+	assert (bins > 0 && bins <= this->bins);
+	assert (this->bins % bins == 0);
+	auxiliary.bins = bins;
+	auxiliary.histogram = features->Require(bins);
+	FoldReference(auxiliary);
+}
+
+/**
+ * Blend the histogram at the MAP estimate into the reference histogram:
+ *   q = q + mu (p - q)
+ * which is what dobots::decreaseDistance does. A convex combination of normalized histograms is again
+ * normalized. There are two gates against a poisoned model. If the MAP particle has a low likelihood,
+ * the object is probably occluded or lost, and nothing is learned. If the blended model would move
+ * too far (in squared Hellinger distance) from the model given at Init, the update is rejected as
+ * well, so the model can follow slow lighting changes but cannot wander off to the background.
+ */
+void PositionParticleFilter::UpdateModel() {
+	RegionEstimate map;
+	if (!GetMapEstimate(map)) return;
+	UpdateModel(map);
+}
 
+/**
+ * The same for a given estimate, for example the single hypothesis in single mode (see SetModeSwitch),
+ * where the other particles are not updated and the MAP estimate would be stale.
+ */
+void PositionParticleFilter::UpdateModel(RegionEstimate & estimate) {
+	if (tracked_object_histogram.empty()) return;
+	if (estimate.likelihood < model_min_likelihood) {
 #ifdef VERBOSE
-	cout << __func__ << ": Calculate distance to histogram of the to-be-tracked object" << endl;
+		cout << __func__ << ": Likelihood of estimate " << estimate.likelihood << " too low, no update" << endl;
 #endif
+		return;
+	}
+	NormalizedHistogramValues observed;
+	GetHistogram(*integral_histogram, estimate.x0, estimate.y0, estimate.x1, estimate.y1, observed);
+	ASSERT_EQUAL(observed.size(), tracked_object_histogram.size());
+
+	NormalizedHistogramValues candidate = tracked_object_histogram;
+	dobots::decreaseDistance(candidate.begin(), candidate.end(), observed.begin(), model_learning_rate);
+	Value drift = Distance(initial_object_histogram, candidate, bins, model_max_drift);
+	if (drift > model_max_drift) {
+		cout << "Model update rejected, drift " << drift << " from initial model" << endl;
+		return;
+	}
+	tracked_object_histogram.swap(candidate);
+	UpdateCascadeReferences();
+}
+
+/**
+ * Helper function for selecting the particles with the highest likelihood (of the previous tick).
+ */
+static bool comp_likelihood(Particle<ParticleState> * p0, Particle<ParticleState> * p1) {
+	return (p0->getState()->likelihood > p1->getState()->likelihood);
+}
+
+/**
+ * Move (the best) particles towards the mode of the likelihood. The reference histogram is the same for all
+ * particles, so it is reduced to a single histogram once: the mean over the parts. The particles with the
+ * highest likelihood in the previous tick are moved to the front, after Resample these are the copies of the
+ * most probable ones.
+ */
+void PositionParticleFilter::MeanShift() {
+	if (tracked_object_histogram.empty()) return;
+	NormalizedHistogramValues target;
+	GetMeanShiftTarget(target);
+
+	std::vector<Particle<ParticleState>* > & particles = getParticles();
+	int count = particles.size();
+	if (mean_shift_particles > 0 && mean_shift_particles < count) {
+		count = mean_shift_particles;
+		std::nth_element(particles.begin(), particles.begin() + count, particles.end(), comp_likelihood);
+	}
+	for (int i = 0; i < count; ++i) {
+		MeanShift(*particles[i]->getState(), target, mean_shift_iterations);
+	}
+}
+
+/**
+ * The reference histogram summed over the parts (and normalized again).
+ */
+void PositionParticleFilter::GetMeanShiftTarget(NormalizedHistogramValues & target) {
+	int parts = tracked_object_histogram.size() / bins;
+	target.assign(bins, Value(0));
+	for (size_t i = 0; i < tracked_object_histogram.size(); ++i) {
+		target[i % bins] += tracked_object_histogram[i] / parts;
+	}
+}
+
+/**
+ * Mean shift over the back-projection of the histogram (Comaniciu, Ramesh, Meer). Every pixel gets the weight
+ *   w_i = sqrt (q_u / p_u)
+ * with u its bin, q the target and p the histogram at the current position. With an Epanechnikov kernel the
+ * new position is just the weighted mean of the pixel coordinates. The histogram p takes a few lookups in the
+ * integral histogram, and the bins of the pixels are in its bin plane, so an iteration is one pass over the
+ * rectangle without any binning. Only the current position is moved, the history is left alone, so the shift
+ * counts as motion. This is on purpose: mean shift moves a particle to where the object is, independent of its
+ * velocity, so if the history would be translated along (as in Regularize) nothing would correct the velocity
+ * any more, and it drifts away from that of the object (see test_mean_shift).
+ */
+void PositionParticleFilter::MeanShift(ParticleState & state, NormalizedHistogramValues & target, int iterations) {
+	const DataValue *bin_plane = integral_histogram->getBinPlane();
+	int width = integral_histogram->getWidth();
+	int height = integral_histogram->getHeight();
+	NormalizedHistogramValues observed;
+	Value ratio[256];
+	for (int it = 0; it < iterations; ++it) {
+		CoordValue x0, y0, x1, y1;
+		GetRegion(state, x0, y0, x1, y1);
+		integral_histogram->getProbabilities(x0, y0, x1, y1, observed);
+		for (int b = 0; b < bins; ++b) {
+			ratio[b] = observed[b] > 0 ? std::sqrt(target[b] / observed[b]) : Value(0);
+		}
+		int cx0 = std::max(x0, 0), cy0 = std::max(y0, 0);
+		int cx1 = std::min(x1, width-1), cy1 = std::min(y1, height-1);
+		Value sum = 0, sum_x = 0, sum_y = 0;
+		for (int y = cy0; y <= cy1; ++y) {
+			const DataValue *row = bin_plane + y * width;
+			Value row_sum = 0, row_x = 0;
+			for (int x = cx0; x <= cx1; ++x) {
+				Value w = ratio[row[x]];
+				row_sum += w;
+				row_x += w * x;
+			}
+			sum += row_sum;
+			sum_x += row_x;
+			sum_y += row_sum * y;
+		}
+		if (sum <= 0) break;
+		// the region is centred on x[0], but the pixel coordinates are relative to the corner
+		Value dx = sum_x / sum - (x0 + x1) / Value(2);
+		Value dy = sum_y / sum - (y0 + y1) / Value(2);
+		state.x[0] = std::max(Value(0), std::min(Value(width-1), state.x[0] + dx));
+		state.y[0] = std::max(Value(0), std::min(Value(height-1), state.y[0] + dy));
+		if (dx * dx + dy * dy < Value(0.25)) break;
+	}
+}
+
+/**
+ * The cloud is unimodal if the effective sample size is large (the weights are spread evenly) and the
+ * particles are close together. Both come with the estimate of the last resampling step (see Estimate),
+ * the spread being the square root of the trace of the weighted covariance of the positions. This needs
+ * to hold for a number of frames in a row. The weighted mean is kept as start position of the single
+ * hypothesis.
+ */
+bool PositionParticleFilter::IsUnimodal() {
+	const ParticleEstimate & estimate = GetEstimate();
+	if (estimate.total <= 0 || estimate.columns < 2) {
+		unimodal_frames = 0;
+		return false;
+	}
+	mode_x = estimate.mean[0];
+	mode_y = estimate.mean[1];
+	cout << "Effective sample size " << estimate.ess << ", spread " << estimate.spread << endl;
+	if (estimate.ess >= mode_min_ess && estimate.spread <= mode_max_spread) {
+		unimodal_frames++;
+	} else {
+		unimodal_frames = 0;
+	}
+	return unimodal_frames >= mode_frames;
+}
+
+/**
+ * Track a single hypothesis: the first particle. It is moved with the motion model without noise and is
+ * refined with mean shift. A single likelihood evaluation checks whether the match is still good enough.
+ * If not, all particles are set to the last state of the single hypothesis and the next ticks run the
+ * full cloud again, which spreads out by the transition noise. The other particles are not touched while
+ * in single mode.
+ */
+void PositionParticleFilter::TickSingle() {
+	Particle<ParticleState> *particle = getParticles().front();
+	ParticleState & state = *particle->getState();
+	Value xn, yn;
+	PredictMean(state, xn, yn);
+	xn = std::max(Value(0), std::min(Value(img->_width-1), xn));
+	yn = std::max(Value(0), std::min(Value(img->_height-1), yn));
+	dobots::pushpop(state.x.begin(), state.x.end(), xn);
+	dobots::pushpop(state.y.begin(), state.y.end(), yn);
+
+	NormalizedHistogramValues target;
+	GetMeanShiftTarget(target);
+	MeanShift(state, target, mode_mean_shift_iterations);
+
+	state.likelihood = Likelihood(state);
+	particle->setWeight(state.likelihood);
+	cout << "Mode: single [" << state.x[0] << ',' << state.y[0] << "] (" << state.likelihood << ")" << endl;
+	if (state.likelihood < mode_min_likelihood) {
+		cout << "Match degraded, switch back to particles" << endl;
+		std::vector<Particle<ParticleState>* >::iterator i;
+		for (i = getParticles().begin() + 1; i != getParticles().end(); ++i) {
+			*(*i)->getState() = state;
+		}
+		for (i = getParticles().begin(); i != getParticles().end(); ++i) {
+			(*i)->setWeight(1);
+		}
+		unimodal_frames = 0;
+		mode = TM_PARTICLES;
+		return;
+	}
+	if (model_learning_rate > 0) {
+		RegionEstimate single;
+		GetRegionEstimate(*particle, single);
+		UpdateModel(single);
+	}
+}
+
+/**
+ * Systematic resampling takes its offset from the van der Corput sequence with quasi-Monte Carlo, and from
+ * drand48 otherwise.
+ */
+void PositionParticleFilter::ResampleSerial() {
+	if (quasi_monte_carlo) {
+		Resample(halton.get(++qmc_tick, 2));
+	} else if (systematic_resampling) {
+		Resample(drand48());
+	} else {
+		Resample();
+	}
+}
+
+/**
+ * Regularized resampling (Musso, Oudjane, Le Gland): resample, then move every particle by a draw of a
+ * Gaussian kernel with covariance h^2 S, where S is the weighted covariance of the positions before
+ * resampling. With S = L L^T (Cholesky) a draw is h L e with e standard normal. The optimal bandwidth for a
+ * Gaussian kernel in d = 2 dimensions is
+ *   h = (4 / (N (d + 2)))^(1 / (d + 4)) = N^(-1/6)
+ * The covariance comes with the estimate of the resampling step itself. The whole history of a particle is
+ * translated, so the velocity that is implied by the AR model is not disturbed.
+ */
+void PositionParticleFilter::Regularize() {
+	ResampleSerial();
+	const ParticleEstimate & estimate = GetEstimate();
+	if (estimate.total <= 0 || estimate.columns < 2) return;
+	double cxx = std::max(estimate.covariance[0][0], 0.0);
+	double cxy = estimate.covariance[1][0];
+	double cyy = std::max(estimate.covariance[1][1], 0.0);
+	// Cholesky of the 2x2 covariance, a degenerate cloud gets no jitter in that direction
+	double l11 = std::sqrt(cxx);
+	double l21 = (l11 > 0) ? cxy / l11 : 0;
+	double l22 = std::sqrt(std::max(cyy - l21 * l21, 0.0));
+	double h = regularization * std::pow((double)getParticles().size(), -1.0 / 6.0);
+	std::vector<Particle<ParticleState>* >::iterator i;
+	for (i = getParticles().begin(); i != getParticles().end(); ++i) {
+		ParticleState *state = (*i)->getState();
+		double e0 = epsilon(), e1 = epsilon();
+		Value dx = h * l11 * e0;
+		Value dy = h * (l21 * e0 + l22 * e1);
+		for (size_t j = 0; j < state->x.size(); ++j) state->x[j] += dx;
+		for (size_t j = 0; j < state->y.size(); ++j) state->y[j] += dy;
+	}
+}
+
+void PositionParticleFilter::SetSmoother(int lag, int particle_count) {
+	smoothing = (lag > 0);
+	if (smoothing) smoother.Configure(lag, particle_count);
+}
+
+/**
+ * The weights are normalized at this point. The particles refer to their parent in the previous generation
+ * by the ancestor index that was set at the previous (recorded) resampling.
+ */
+bool PositionParticleFilter::Record() {
+	if (in_first_stage) return false;
+	if (!smoothing && !offline_smoothing) return true;
+	std::vector<Particle<ParticleState>* > & particles = getParticles();
+	if (smoothing) {
+		ASSERT_EQUAL(particles.size(), smoother.getParticles());
+		smoother.Next();
+	}
+	if (offline_smoothing) {
+		ASSERT_EQUAL(particles.size(), offline_smoother.getParticles());
+		if (!offline_smoother.Next()) offline_smoothing = false;
+	}
+	PositionSnapshot snapshot;
+	for (size_t k = 0; k < particles.size(); ++k) {
+		ParticleState *state = particles[k]->getState();
+		snapshot.x = state->x[0];
+		snapshot.y = state->y[0];
+		snapshot.scale = state->scale[0];
+		snapshot.likelihood = state->likelihood;
+		PredictMean(*state, snapshot.mean_x, snapshot.mean_y);
+		if (smoothing) {
+			int parent = (smoother.getGenerations() > 1) ? particles[k]->getAncestor() : -1;
+			smoother.Set(k, snapshot, particles[k]->getWeight(), parent);
+		}
+		if (offline_smoothing) {
+			offline_smoother.Set(k, snapshot, particles[k]->getWeight());
+		}
+	}
+	return true;
+}
+
+/**
+ * The weighted mean over the particles of the last generation of the positions of their ancestors. This
+ * walks back the lineage of every particle, so costs particles x back steps, without allocations.
+ */
+bool PositionParticleFilter::GetSmoothedPosition(int back, Value & x, Value & y) {
+	if (!smoothing || back > smoother.getLag() || back >= smoother.getGenerations()) return false;
+	double sum = 0, sum_x = 0, sum_y = 0;
+	for (int k = 0; k < smoother.getParticles(); ++k) {
+		int a = smoother.getAncestor(k, back);
+		if (a < 0) continue;
+		double w = smoother.getWeight(k);
+		const PositionSnapshot & snapshot = smoother.getSnapshot(a, back);
+		sum += w;
+		sum_x += w * snapshot.x;
+		sum_y += w * snapshot.y;
+	}
+	if (sum <= 0) return false;
+	x = sum_x / sum;
+	y = sum_y / sum;
+	return true;
+}
+
+void PositionParticleFilter::SetOfflineSmoother(int particle_count, size_t memory_limit) {
+	offline_smoothing = (particle_count > 0);
+	if (offline_smoothing) offline_smoother.Configure(particle_count, memory_limit);
+}
+
+/**
+ * The transition noise of the motion model is the standard deviation of the kernel. The predicted mean
+ * of every particle is stored with its snapshot, so the kernel itself does not need the history.
+ */
+void PositionParticleFilter::SmoothSequence(int trajectories, int max_trials) {
+	if (!offline_smoothing) return;
+	PositionTransitionKernel kernel(transition_noise);
+	offline_smoother.Smooth(trajectories, kernel, max_trials);
+	cout << "Smoothed " << offline_smoother.getFrames() << " frames: " << offline_smoother.getTrials() << " trials, ";
+	cout << offline_smoother.getFallbacks() << " exact draws" << endl;
+}
 
-	Value dist = dobots::distance<Value>(tracked_object_histogram.begin(), tracked_object_histogram.end(), result.begin(), result.end(),
-			dobots::DM_SQUARED_HELLINGER);
-	return std::exp(-20.0 * dist);
+bool PositionParticleFilter::GetOfflinePosition(int frame, Value & x, Value & y) {
+	int trajectories = offline_smoother.getTrajectories();
+	if (!trajectories || frame < 0 || frame >= offline_smoother.getFrames()) return false;
+	double sum_x = 0, sum_y = 0;
+	for (int j = 0; j < trajectories; ++j) {
+		const PositionSnapshot & snapshot = offline_smoother.getSmoothed(j, frame);
+		sum_x += snapshot.x;
+		sum_y += snapshot.y;
+	}
+	x = sum_x / trajectories;
+	y = sum_y / trajectories;
+	return true;
+}
+
+/**
+ * Dispatch to the right query on the integral histogram.
+ */
+void PositionParticleFilter::GetHistogram(IntegralHistogram & histogram, CoordValue x0, CoordValue y0,
+		CoordValue x1, CoordValue y1, NormalizedHistogramValues & result) {
+	if (part_columns * part_rows > 1) {
+		histogram.getPartProbabilities(x0, y0, x1, y1, part_columns, part_rows, result);
+	} else if (kernel_layers) {
+		histogram.getKernelProbabilities(x0, y0, x1, y1, kernel_layers, result);
+	} else {
+		histogram.getProbabilities(x0, y0, x1, y1, result);
+	}
+}
+
+/**
+ * Everything this filter needs is required from the new features before it is released from the old ones,
+ * so histograms that both need are not recalculated.
+ */
+void PositionParticleFilter::SetFrameFeatures(FrameFeatures *shared) {
+	FrameFeatures *next = (shared != NULL) ? shared : &own_features;
+	if (next == features) return;
+	integral_histogram = next->Require(bins);
+	features->Release(bins);
+	for (size_t s = 0; s < cascade.size(); ++s) {
+		cascade[s].histogram = next->Require(cascade[s].bins);
+		features->Release(cascade[s].bins);
+	}
+	if (auxiliary.histogram != NULL) {
+		auxiliary.histogram = next->Require(auxiliary.bins);
+		features->Release(auxiliary.bins);
+	}
+	if (min_coverage > 0) {
+		next->RequireBackground();
+		features->ReleaseBackground();
+	}
+	features = next;
+	img = features->getImage();
+}
+
+void PositionParticleFilter::SetForegroundGate(Value min_coverage, Value likelihood) {
+	if (min_coverage > 0 && this->min_coverage <= 0) features->RequireBackground();
+	if (min_coverage <= 0 && this->min_coverage > 0) features->ReleaseBackground();
+	this->min_coverage = min_coverage;
+	background_likelihood = likelihood;
+}
+
+void PositionParticleFilter::AddCascadeStage(int bins, Value threshold) {
+	assert (bins > 0 && bins < this->bins);
+	assert (this->bins % bins == 0);
+	CascadeStage stage;
+	stage.bins = bins;
+	stage.threshold = threshold;
+	stage.log_threshold = std::log(threshold);
+	stage.histogram = features->Require(bins);
+	stage.evaluated = stage.rejected = 0;
+	cascade.push_back(stage);
+	UpdateCascadeReferences();
 }
 
+void PositionParticleFilter::ClearCascade() {
+	for (size_t s = 0; s < cascade.size(); ++s) {
+		features->Release(cascade[s].bins);
+	}
+	cascade.clear();
+}
+
+void PositionParticleFilter::GetCascadeCounters(int stage, long & evaluated, long & rejected) {
+	assert (stage >= 0 && stage < (int)cascade.size());
+	evaluated = cascade[stage].evaluated;
+	rejected = cascade[stage].rejected;
+}
+
+void PositionParticleFilter::ResetCascadeCounters() {
+	for (size_t s = 0; s < cascade.size(); ++s) {
+		cascade[s].evaluated = cascade[s].rejected = 0;
+	}
+}
+
+/**
+ * Bins are uniform over [0,255], so coarse bin b consists of the fine bins b*f..(b+1)*f-1 with f
+ * the ratio between the number of bins. This is done per part.
+ */
+void PositionParticleFilter::UpdateCascadeReferences() {
+	for (size_t s = 0; s < cascade.size(); ++s) {
+		FoldReference(cascade[s]);
+	}
+	if (auxiliary.histogram != NULL) {
+		FoldReference(auxiliary);
+	}
+}
+
+void PositionParticleFilter::FoldReference(CascadeStage & stage) {
+	if (tracked_object_histogram.empty()) return;
+	int parts = tracked_object_histogram.size() / bins;
+	int factor = bins / stage.bins;
+	stage.reference.assign(parts * stage.bins, Value(0));
+	for (size_t i = 0; i < tracked_object_histogram.size(); ++i) {
+		int p = i / bins, b = i % bins;
+		stage.reference[p * stage.bins + b / factor] += tracked_object_histogram[i];
+	}
+}
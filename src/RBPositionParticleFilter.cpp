@@ -0,0 +1,129 @@
+/**
+ * @brief Rao-Blackwellized particle filter for position with analytic velocity
+ * @file RBPositionParticleFilter.cpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+#include <RBPositionParticleFilter.h>
+
+#include <cmath>
+
+using namespace std;
+
+/* **************************************************************************************
+ * Implementation of RBPositionParticleFilter
+ * **************************************************************************************/
+
+RBPositionParticleFilter::RBPositionParticleFilter(): random_number_generator(dobots::autoregression_seed),
+		normal_dist(0, 1),
+		epsilon(random_number_generator, normal_dist) {
+	SetNoise(1.0, 0.5, 4.0);
+}
+
+RBPositionParticleFilter::~RBPositionParticleFilter() {
+
+}
+
+void RBPositionParticleFilter::SetNoise(Value position, Value velocity, Value initial_velocity) {
+	position_variance = position * position;
+	process_variance = velocity * velocity;
+	initial_variance = initial_velocity * initial_velocity;
+}
+
+void RBPositionParticleFilter::Init(NormalizedHistogramValues &tracked_object_histogram,
+		CImg<CoordValue> &coord, int particle_count) {
+	PositionParticleFilter::Init(tracked_object_histogram, coord, particle_count);
+	InitVelocity();
+}
+
+void RBPositionParticleFilter::Init(CImg<DataValue> &frame, CImg<CoordValue> &coord, int particle_count) {
+	PositionParticleFilter::Init(frame, coord, particle_count);
+	InitVelocity();
+}
+
+void RBPositionParticleFilter::InitVelocity() {
+	std::vector<Particle<ParticleState>* >::iterator i;
+	for (i = getParticles().begin(); i != getParticles().end(); ++i) {
+		ParticleState *state = (*i)->getState();
+		for (int d = 0; d < 2; ++d) {
+			state->velocity[d] = 0;
+			state->velocity_variance[d] = initial_variance;
+		}
+	}
+}
+
+/**
+ * The particles move by their velocity, so that is also where the auxiliary first stage and the single
+ * hypothesis expect them.
+ */
+void RBPositionParticleFilter::PredictMean(ParticleState & state, Value & x, Value & y) {
+	x = state.x[0] + state.velocity[0];
+	y = state.y[0] + state.velocity[1];
+}
+
+/**
+ * The history of the position is kept up to date as well, so the particles can be displayed and
+ * compared in the same way as those of the PositionParticleFilter. Later layers of an annealed
+ * tick are on the same frame, there the base class only diffuses the position and the velocity
+ * is left alone. The noise is drawn from the generator of this filter, or given (for quasi-Monte
+ * Carlo) as standard normal values.
+ */
+void RBPositionParticleFilter::Transition(ParticleState &state) {
+	Value noise_x = epsilon();
+	Value noise_y = epsilon();
+	Transition(state, noise_x, noise_y);
+}
+
+void RBPositionParticleFilter::Transition(ParticleState &state, Value noise_x, Value noise_y) {
+	if (IsDiffusionOnly()) {
+		PositionParticleFilter::Transition(state, noise_x, noise_y);
+		return;
+	}
+	CImg<DataValue> *img = GetImage();
+	assert (img != NULL);
+	Value xn = Transition(state.x[0], state.velocity[0], state.velocity_variance[0], noise_x);
+	Value yn = Transition(state.y[0], state.velocity[1], state.velocity_variance[1], noise_y);
+	xn = std::max(Value(0), std::min(Value(img->_width-1), xn));
+	yn = std::max(Value(0), std::min(Value(img->_height-1), yn));
+
+	dobots::pushpop(state.x.begin(), state.x.end(), xn);
+	dobots::pushpop(state.y.begin(), state.y.end(), yn);
+	dobots::pushpop(state.scale.begin(), state.scale.end(), Value(1));
+}
+
+/**
+ * Kalman prediction of the velocity, sampling of the position from the predictive distribution, and
+ * the Kalman update with the sampled displacement as measurement:
+ *   P = P + q
+ *   d ~ N(m, P + r)
+ *   K = P / (P + r)
+ *   m = m + K (d - m)
+ *   P = (1 - K) P
+ */
+Value RBPositionParticleFilter::Transition(Value position, Value & velocity, Value & velocity_variance,
+		Value noise) {
+	Value variance = velocity_variance + process_variance;
+	Value innovation_variance = variance + position_variance;
+	Value displacement = velocity + std::sqrt(innovation_variance) * noise;
+	Value gain = variance / innovation_variance;
+	velocity += gain * (displacement - velocity);
+	velocity_variance = (1 - gain) * variance;
+	return position + displacement;
+}
@@ -40,6 +40,15 @@
 #include <testHistogram.h>
 #include <testFilter.h>
 #include <testConvolution.h>
+#include <testIntegralHistogram.h>
+#include <testVectorFilter.h>
+#include <testQuasiMonteCarlo.h>
+#include <testOfflineSmoother.h>
+#include <testFilterBank.h>
+#include <testMultiTargetTracker.h>
+#include <testMonteCarloLocalization.h>
+#include <testPositionParticleFilter.h>
+#include <testBackgroundModel.h>
 #include <createTrackImage.h>
 #include <createImages.h>
 
@@ -84,9 +93,33 @@ int main() {
 //	test_histogram();
 //	test_autoregression();
 //	test_filter();
+//	test_filter_parallel_resample();
+//	test_fixed_lag_smoother();
+//	test_filter_estimate();
+//	test_top_estimates();
 //	test_distance();
 //	create_track_image();
 //	test_convolution();
+//	test_integral_histogram();
+//	test_vector_filter_transition();
+//	test_vector_filter_benchmark();
+//	test_quasi_monte_carlo();
+//	test_offline_smoother_exact();
+//	test_offline_smoother_mapped();
+//	test_filter_bank_pool();
+//	test_multi_target_interaction();
+//	test_multi_target_crossing();
+//	test_mcl_distance_transform();
+//	test_mcl_localization();
+//	test_cascade();
+//	test_model_update();
+//	test_background_model();
+//	test_mean_shift();
+//	test_annealing();
+//	test_rao_blackwellized();
+//	test_mode_switch();
+//	test_auxiliary();
+//	test_regularization();
 	create_images();
 	return EXIT_SUCCESS;
 
@@ -139,7 +172,7 @@ int main() {
 	int shift = 4;
 	filter.Init(result, img_coords, particles);
 
-	vector <CImg<CoordValue>*> coordinates;
+	RegionEstimate estimates[10];
 
 	int frame_count = 40;
 	int frame_id = 0;
@@ -154,22 +187,16 @@ int main() {
 //		return 1;
 #endif
 
-		cout << "Clear coordinates" << endl;
-		coordinates.erase(coordinates.begin(), coordinates.end());
-		coordinates.clear();
-		filter.GetParticleCoordinates(coordinates);
-
-		CImg<DataValue> &img_copy = *new CImg<DataValue>(img);
-		int max = 10;
-		for (int i = 0; i < coordinates.size(); ++i) {
-			CImg<CoordValue>* coord = coordinates[i];
-			//cout << "Draw rectangle at: [" << coord->_data[0] << "," << coord->_data[1] << "," << coord->_data[3] << "," << coord->_data[4] << "]" << endl;
-			float opacity = 0.05;
-			img_copy.draw_line(coord->_data[0], coord->_data[1], coord->_data[0], coord->_data[4], red);
-			img_copy.draw_line(coord->_data[0], coord->_data[1], coord->_data[3], coord->_data[1], red);
-			img_copy.draw_line(coord->_data[3], coord->_data[1], coord->_data[3], coord->_data[4], red);
-			img_copy.draw_line(coord->_data[0], coord->_data[4], coord->_data[3], coord->_data[4], red);
-			if (--max == 0) break;
+		int count = filter.GetTopEstimates(estimates, 10);
+
+		CImg<DataValue> img_copy(img);
+		for (int i = 0; i < count; ++i) {
+			RegionEstimate & e = estimates[i];
+			//cout << "Draw rectangle at: [" << e.x0 << "," << e.y0 << "," << e.x1 << "," << e.y1 << "]" << endl;
+			img_copy.draw_line(e.x0, e.y0, e.x0, e.y1, red);
+			img_copy.draw_line(e.x0, e.y0, e.x1, e.y0, red);
+			img_copy.draw_line(e.x1, e.y0, e.x1, e.y1, red);
+			img_copy.draw_line(e.x0, e.y1, e.x1, e.y1, red);
 		}
 
 		CImgDisplay main_disp(img_copy, "Show image");
@@ -0,0 +1,115 @@
+/**
+ * @brief
+ * @file testBackgroundModel.h
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+
+
+#ifndef TESTBACKGROUNDMODEL_H_
+#define TESTBACKGROUNDMODEL_H_
+
+#include <BackgroundModel.h>
+#include <CImg.h>
+
+#include <testPositionParticleFilter.h>
+
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+using namespace cimg_library;
+using namespace std;
+
+/**
+ * A static checkerboard, first without and then with the box of the synthetic sequence moving over it. The
+ * box differs by more than 50 grey values from the background, so after the first frame the foreground
+ * mask should be exactly the box. The number of foreground pixels in random rectangles, partly outside of
+ * the frame as well, should be the brute-force count over the mask. With the foreground gate, the filter
+ * should give the fixed likelihood to a rectangle without foreground, but not to the box itself once it
+ * has left the place where it was when the model started.
+ */
+void test_background_model() {
+	cout << " === start test background model === " << endl;
+
+	int width = 200, height = 120, frames = 10;
+	srand48(1);
+	CImg<DataValue> img(width, height, 1, 3);
+	for (int j = 0; j < height; ++j) {
+		for (int i = 0; i < width; ++i) {
+			DataValue v = ((i / 10 + j / 10) % 2) ? 40 : 90;
+			img(i, j, 0, 0) = img(i, j, 0, 1) = img(i, j, 0, 2) = v;
+		}
+	}
+	BackgroundModel model;
+	model.Update(img);
+	for (int p = 0; p < width * height; ++p) assert (model.getMask()[p] == 0);
+
+	for (int t = 1; t <= frames; ++t) {
+		int x = 10 * t, y = 40 + t;
+		draw_synthetic_frame(img, x, y);
+		model.Update(img);
+		const DataValue *mask = model.getMask();
+		for (int j = 0; j < height; ++j) {
+			for (int i = 0; i < width; ++i) {
+				bool box = (i >= x && i < x + 20 && j >= y && j < y + 30);
+				assert (mask[j * width + i] == (box ? 1 : 0));
+			}
+		}
+		for (int r = 0; r < 20; ++r) {
+			int x0 = (int)(drand48() * (width + 40)) - 20, y0 = (int)(drand48() * (height + 40)) - 20;
+			int x1 = x0 + (int)(drand48() * 60), y1 = y0 + (int)(drand48() * 60);
+			int count = 0;
+			for (int j = std::max(y0, 0); j <= std::min(y1, height - 1); ++j) {
+				for (int i = std::max(x0, 0); i <= std::min(x1, width - 1); ++i) {
+					count += mask[j * width + i];
+				}
+			}
+			assert (model.getForeground(x0, y0, x1, y1) == count);
+			Value area = (x1 - x0 + 1) * (y1 - y0 + 1);
+			assert (std::fabs(model.getCoverage(x0, y0, x1, y1) - count / area) < 1e-6);
+		}
+	}
+	cout << "Foreground mask, counts and coverage match over " << frames << " frames" << endl;
+
+	int x = 60, y = 40;
+	Value background_likelihood = 1e-6;
+	ProbeParticleFilter filter;
+	filter.SetForegroundGate(0.5, background_likelihood);
+	std::streambuf *buffer = cout.rdbuf(0);
+	init_synthetic_filter(filter, img, x, y, 100);
+	// the frame at Init has no foreground, so nothing is gated
+	assert (filter.LikelihoodAt(20, 20) != background_likelihood);
+	for (int t = 1; t <= 3; ++t) {
+		x += 10;
+		draw_synthetic_frame(img, x, y);
+		filter.Tick(&img, 1);
+	}
+	cout.rdbuf(buffer);
+	Value gated = filter.LikelihoodAt(20, 20), box = filter.LikelihoodAt(x + 9, y + 14);
+	cout << "Likelihood on the background " << gated << ", on the box " << box << endl;
+	assert (std::fabs(gated - background_likelihood) < 1e-4 * background_likelihood);
+	assert (box > 0.1);
+
+	cout << " === end test background model === " << endl;
+}
+
+#endif /* TESTBACKGROUNDMODEL_H_ */
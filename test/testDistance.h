@@ -121,6 +121,20 @@ void test_distance() {
 	set0.clear();
 	set1.clear();
 
+	// early abandoning returns the exact distance below the cutoff and a bound above the cutoff otherwise
+	TESTPOINT_DEF h0, h1;
+	TESTVALUE v0[] = { 0.5, 0.3, 0.1, 0.1 }, v1[] = { 0.1, 0.1, 0.3, 0.5 };
+	h0.assign(v0, v0 + 4); h1.assign(v1, v1 + 4);
+	DistanceMetric metrics[] = { DM_SQUARED_HELLINGER, DM_BHATTACHARYYA, DM_HELLINGER, DM_MANHATTAN };
+	for (int m = 0; m < 4; ++m) {
+		TESTVALUE exact = dobots::distance<TESTVALUE>(h0.begin(), h0.end(), h1.begin(), h1.end(), metrics[m]);
+		TESTVALUE above = dobots::distance_bounded<TESTVALUE>(h0.begin(), h0.end(), h1.begin(), h1.end(), metrics[m], exact*2);
+		TESTVALUE below = dobots::distance_bounded<TESTVALUE>(h0.begin(), h0.end(), h1.begin(), h1.end(), metrics[m], exact/2);
+		cout << "Bounded distance " << m << ": exact " << exact << ", with cutoff above " << above << ", below " << below << endl;
+		assert (std::abs(above - exact) < 1e-9);
+		assert (below > exact/2 && below <= exact + 1e-9);
+	}
+
 	cout << " === end test distance metrics === " << endl;
 }
 
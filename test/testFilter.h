@@ -22,8 +22,14 @@
  */
 
 #include <ParticleFilter.hpp>
+#include <FixedLagSmoother.hpp>
+#include <PositionParticleFilter.h>
 #include <Print.hpp>
 #include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
 
 using namespace dobots;
 
@@ -85,3 +91,351 @@ void test_filter() {
 	filter.Resample();
 	filter.Print();
 }
+
+/**
+ * A filter with enough particles to be split in several chunks by ResampleParallel. The particles are
+ * numbered in fieldA, so the result of resampling is the sequence of numbers.
+ */
+class ChunkedTestParticleFilter: public ParticleFilter<TestData> {
+public:
+	ChunkedTestParticleFilter(int particle_count, bool zero_weights) {
+		for (int i = 0; i < particle_count; ++i) {
+			TestData *data = new TestData();
+			data->fieldA = i; data->fieldB = 0;
+			getParticles().push_back(new Particle<TestData>(data, zero_weights ? 0 : drand48()));
+		}
+	}
+
+	~ChunkedTestParticleFilter() {
+		for (size_t i = 0; i < getParticles().size(); ++i) delete getParticles()[i];
+	}
+
+	void GetNumbers(std::vector<int> & numbers) {
+		numbers.clear();
+		for (size_t i = 0; i < getParticles().size(); ++i) numbers.push_back(getParticles()[i]->getState()->fieldA);
+	}
+
+	void Transition() {
+		assert(false);
+	}
+
+	void Likelihood() {
+		assert(false);
+	}
+};
+
+/**
+ * ResampleParallel should give the same particles without a pool, with a single worker and with several
+ * workers. If all weights are zero, it falls back to uniform weights and keeps every particle once.
+ */
+void test_filter_parallel_resample() {
+	cout << " === start test filter parallel resample === " << endl;
+
+	int particle_count = 3 * RESAMPLE_CHUNK + 100;
+	WorkerPool one(1), several(4);
+	WorkerPool *pools[3] = { NULL, &one, &several };
+	for (int zero = 0; zero < 2; ++zero) {
+		std::vector<int> numbers[3];
+		for (int p = 0; p < 3; ++p) {
+			srand48(1);
+			ChunkedTestParticleFilter filter(particle_count, zero);
+			filter.SetWorkerPool(pools[p]);
+			filter.ResampleParallel(0.5);
+			filter.GetNumbers(numbers[p]);
+		}
+		assert (numbers[1] == numbers[0]);
+		assert (numbers[2] == numbers[0]);
+		if (zero) {
+			std::sort(numbers[0].begin(), numbers[0].end());
+			for (int i = 0; i < particle_count; ++i) assert (numbers[0][i] == i);
+		}
+		cout << "Same particles with and without pool" << (zero ? " for zero weights" : "") << endl;
+	}
+
+	cout << " === end test filter parallel resample === " << endl;
+}
+
+//! The part of TestData that is stored per generation
+struct TestSnapshot {
+	int id;
+};
+
+/**
+ * A filter that stores every generation in a fixed-lag smoother. The particles are numbered in fieldA by
+ * Renumber, uniquely over all generations, so the lineage can be checked from the numbers.
+ */
+class LineageTestParticleFilter: public ParticleFilter<TestData> {
+public:
+	LineageTestParticleFilter(int particle_count, int lag) {
+		for (int i = 0; i < particle_count; ++i) {
+			TestData *data = new TestData();
+			data->fieldA = i; data->fieldB = 0;
+			getParticles().push_back(new Particle<TestData>(data, 1));
+		}
+		smoother.Configure(lag, particle_count);
+	}
+
+	~LineageTestParticleFilter() {
+		for (size_t i = 0; i < getParticles().size(); ++i) delete getParticles()[i];
+	}
+
+	//! Number the particles of a generation and give them random weights
+	void Renumber(int generation) {
+		int N = getParticles().size();
+		for (int i = 0; i < N; ++i) {
+			getParticles()[i]->getState()->fieldA = generation * N + i;
+			getParticles()[i]->setWeight(0.01 + drand48());
+		}
+	}
+
+	int GetNumber(int i) { return getParticles()[i]->getState()->fieldA; }
+
+	int GetAncestor(int i) { return getParticles()[i]->getAncestor(); }
+
+	void Transition() {
+		assert(false);
+	}
+
+	void Likelihood() {
+		assert(false);
+	}
+
+	FixedLagSmoother<TestSnapshot> smoother;
+
+protected:
+	bool Record() {
+		smoother.Next();
+		for (size_t k = 0; k < getParticles().size(); ++k) {
+			TestSnapshot snapshot;
+			snapshot.id = getParticles()[k]->getState()->fieldA;
+			int parent = (smoother.getGenerations() > 1) ? getParticles()[k]->getAncestor() : -1;
+			smoother.Set(k, snapshot, getParticles()[k]->getWeight(), parent);
+		}
+		return true;
+	}
+};
+
+/**
+ * Resample with Resample(), Resample(offset) and ResampleParallel in turn, for more generations than fit in
+ * the smoother. After every step, each particle should be a copy of the particle its ancestor index refers
+ * to. The ancestors at every lag up to L should be those traced by hand through the ancestor indices, with
+ * the snapshot and the lineage of those particles. Once the buffer is full, a generation should reuse the
+ * slot of the generation L+1 steps earlier, in the memory allocated by Configure.
+ */
+void test_fixed_lag_smoother() {
+	cout << " === start test fixed lag smoother === " << endl;
+
+	int particle_count = 50, lag = 3, steps = 12;
+	srand48(1);
+	LineageTestParticleFilter filter(particle_count, lag);
+	size_t footprint = filter.smoother.getMemoryFootprint();
+	std::vector<std::vector<int> > ancestors;
+	std::vector<const TestSnapshot*> slots;
+	std::vector<TestSnapshot> lineage(lag + 1);
+	for (int g = 0; g < steps; ++g) {
+		filter.Renumber(g);
+		switch (g % 3) {
+		case 0: filter.Resample(); break;
+		case 1: filter.Resample(drand48()); break;
+		case 2: filter.ResampleParallel(drand48()); break;
+		}
+		std::vector<int> generation(particle_count);
+		for (int k = 0; k < particle_count; ++k) {
+			generation[k] = filter.GetAncestor(k);
+			assert (generation[k] >= 0 && generation[k] < particle_count);
+			assert (filter.GetNumber(k) == g * particle_count + generation[k]);
+		}
+		ancestors.push_back(generation);
+
+		// the smoother has generation g, its parents are the ancestors of the previous step
+		slots.push_back(&filter.smoother.getSnapshot(0, 0));
+		if (g > lag) assert (slots[g] == slots[g - lag - 1]);
+		assert (filter.smoother.getMemoryFootprint() == footprint);
+		int generations = filter.smoother.getGenerations();
+		assert (generations == std::min(g + 1, lag + 1));
+		for (int k = 0; k < particle_count; ++k) {
+			int a = k;
+			for (int back = 0; back < generations; ++back) {
+				if (back > 0) a = ancestors[g - back][a];
+				assert (filter.smoother.getAncestor(k, back) == a);
+				assert (filter.smoother.getSnapshot(a, back).id == (g - back) * particle_count + a);
+			}
+			int count = filter.smoother.getLineage(k, &lineage[0]);
+			assert (count == generations);
+			assert (lineage[0].id == (g - generations + 1) * particle_count + a);
+			assert (lineage[count - 1].id == g * particle_count + k);
+		}
+	}
+	cout << "Ancestors and lineages match over " << steps << " generations with lag " << lag << endl;
+
+	cout << " === end test fixed lag smoother === " << endl;
+}
+
+//! A position filter of which the likelihoods of the particles can be set
+class RankingTestParticleFilter: public PositionParticleFilter {
+public:
+	//! Put particle i at x=i, with the given likelihood and a weight that follows from it
+	void Place(int i, Value likelihood) {
+		ParticleState & state = *getParticles()[i]->getState();
+		std::fill(state.x.begin(), state.x.end(), Value(i));
+		state.likelihood = likelihood;
+		getParticles()[i]->setWeight(2 * likelihood);
+	}
+};
+
+/**
+ * GetTopEstimates for several k against the first k of all particles sorted on likelihood, and
+ * GetMapEstimate against the first of them. The likelihoods are distinct, so the order is unique. If k
+ * is larger than the number of particles, all particles should be returned.
+ */
+void test_top_estimates() {
+	cout << " === start test top estimates === " << endl;
+
+	int particle_count = 500;
+	srand48(1);
+	RankingTestParticleFilter filter;
+	NormalizedHistogramValues histogram(16, Value(1) / 16);
+	CImg<CoordValue> coords(6);
+	coords(0) = 0; coords(1) = 0; coords(3) = 19; coords(4) = 29;
+	std::streambuf *buffer = cout.rdbuf(0);
+	filter.Init(histogram, coords, particle_count);
+	cout.rdbuf(buffer);
+	std::vector<std::pair<Value, int> > sorted(particle_count);
+	for (int i = 0; i < particle_count; ++i) {
+		sorted[i] = std::make_pair(Value(drand48()), i);
+		filter.Place(i, sorted[i].first);
+	}
+	std::sort(sorted.rbegin(), sorted.rend());
+
+	int ks[4] = { 0, 1, 10, 137 };
+	for (int t = 0; t < 4; ++t) {
+		int k = ks[t];
+		std::vector<RegionEstimate> top(k + 1);
+		assert (filter.GetTopEstimates(&top[0], k) == k);
+		for (int i = 0; i < k; ++i) {
+			assert (top[i].likelihood == sorted[i].first && top[i].x == sorted[i].second);
+			assert (top[i].weight == 2 * sorted[i].first);
+		}
+	}
+	std::vector<RegionEstimate> all(particle_count + 10);
+	assert (filter.GetTopEstimates(&all[0], particle_count + 10) == particle_count);
+	for (int i = 0; i < particle_count; ++i) assert (all[i].x == sorted[i].second);
+
+	RegionEstimate map;
+	assert (filter.GetMapEstimate(map));
+	assert (map.likelihood == sorted[0].first && map.x == sorted[0].second);
+	assert (map.x0 == all[0].x0 && map.y0 == all[0].y0 && map.x1 == all[0].x1 && map.y1 == all[0].y1);
+	cout << "Top estimates and MAP match the full sort of " << particle_count << " particles" << endl;
+
+	cout << " === end test top estimates === " << endl;
+}
+
+/**
+ * A filter of which fieldA and fieldB are estimated. The numbers are far from zero with a small spread,
+ * where a single pass without a shift would lose the covariance.
+ */
+class MomentTestParticleFilter: public ParticleFilter<TestData> {
+public:
+	MomentTestParticleFilter(int particle_count) {
+		for (int i = 0; i < particle_count; ++i) {
+			TestData *data = new TestData();
+			data->fieldA = 1000000 + (int)(drand48() * 100);
+			data->fieldB = -2000000 + data->fieldA / 2 + (int)(drand48() * 40);
+			getParticles().push_back(new Particle<TestData>(data, drand48() * drand48()));
+		}
+	}
+
+	~MomentTestParticleFilter() {
+		for (size_t i = 0; i < getParticles().size(); ++i) delete getParticles()[i];
+	}
+
+	void GetWeights(std::vector<double> & weights) {
+		weights.clear();
+		for (size_t i = 0; i < getParticles().size(); ++i) weights.push_back(getParticles()[i]->getWeight());
+	}
+
+	void GetValues(std::vector<double> & values) {
+		values.clear();
+		for (size_t i = 0; i < getParticles().size(); ++i) {
+			values.push_back(getParticles()[i]->getState()->fieldA);
+			values.push_back(getParticles()[i]->getState()->fieldB);
+		}
+	}
+
+	void Transition() {
+		assert(false);
+	}
+
+	void Likelihood() {
+		assert(false);
+	}
+
+protected:
+	int EstimateColumns() { return 2; }
+
+	void GetColumns(TestData & state, double *values) {
+		values[0] = state.fieldA;
+		values[1] = state.fieldB;
+	}
+};
+
+/**
+ * The fused estimate against a naive computation in two passes, first the mean, then the covariance
+ * around it, for several chunks of particles, without a pool and with four workers. The weights should
+ * be normalized afterwards.
+ */
+void test_filter_estimate() {
+	cout << " === start test filter estimate === " << endl;
+
+	int particle_count = 3 * RESAMPLE_CHUNK + 17;
+	WorkerPool several(4);
+	WorkerPool *pools[2] = { NULL, &several };
+	for (int p = 0; p < 2; ++p) {
+		srand48(1);
+		MomentTestParticleFilter filter(particle_count);
+		filter.SetWorkerPool(pools[p]);
+		std::vector<double> weights, values;
+		filter.GetWeights(weights);
+		filter.GetValues(values);
+
+		double total = 0, total_squared = 0, mean[2] = { 0, 0 }, covariance[2][2] = { { 0, 0 }, { 0, 0 } };
+		for (int i = 0; i < particle_count; ++i) {
+			total += weights[i];
+			total_squared += weights[i] * weights[i];
+			for (int k = 0; k < 2; ++k) mean[k] += weights[i] * values[2 * i + k];
+		}
+		for (int k = 0; k < 2; ++k) mean[k] /= total;
+		for (int i = 0; i < particle_count; ++i) {
+			for (int k = 0; k < 2; ++k) {
+				for (int l = 0; l < 2; ++l) {
+					covariance[k][l] += weights[i] * (values[2 * i + k] - mean[k]) * (values[2 * i + l] - mean[l]);
+				}
+			}
+		}
+		double ess = total * total / total_squared / particle_count;
+
+		ParticleEstimate estimate;
+		assert (filter.Estimate(estimate));
+		assert (estimate.columns == 2);
+		assert (std::fabs(estimate.total - total) < 1e-9 * total);
+		assert (std::fabs(estimate.ess - ess) < 1e-9);
+		double trace = 0;
+		for (int k = 0; k < 2; ++k) {
+			assert (std::fabs(estimate.mean[k] - mean[k]) < 1e-6);
+			for (int l = 0; l < 2; ++l) {
+				covariance[k][l] /= total;
+				assert (std::fabs(estimate.covariance[k][l] - covariance[k][l]) < 1e-6 * std::fabs(covariance[k][k]));
+			}
+			trace += covariance[k][k];
+		}
+		assert (std::fabs(estimate.spread - std::sqrt(trace)) < 1e-6);
+		std::vector<double> normalized;
+		filter.GetWeights(normalized);
+		for (int i = 0; i < particle_count; ++i) assert (std::fabs(normalized[i] - weights[i] / total) < 1e-12);
+		cout << "Pool " << p << ": mean " << estimate.mean[0] << "," << estimate.mean[1] << " ess " << estimate.ess
+				<< " covariance " << estimate.covariance[0][0] << "," << estimate.covariance[0][1] << ","
+				<< estimate.covariance[1][1] << endl;
+	}
+
+	cout << " === end test filter estimate === " << endl;
+}
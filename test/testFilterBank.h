@@ -0,0 +1,116 @@
+/**
+ * @brief
+ * @file testFilterBank.h
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+
+
+#ifndef TESTFILTERBANK_H_
+#define TESTFILTERBANK_H_
+
+#include <FilterBank.hpp>
+#include <WorkerPool.hpp>
+
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+/**
+ * K independent random walks in the plane, every filter observes its own target with Gaussian noise.
+ */
+class RandomWalkBank: public FilterBank<2> {
+public:
+	RandomWalkBank(int filters, int particles): FilterBank<2>(filters, particles),
+			target_x(filters), target_y(filters) {}
+
+	std::vector<float> target_x, target_y;
+
+protected:
+	void Transition(int begin, int end) {
+		float *x = getColumn(0), *y = getColumn(1);
+		int N = getParticles();
+		for (int k = begin / N; k < end / N; ++k) {
+			unsigned short *seed = getSeed(k);
+			for (int i = k * N; i < (k + 1) * N; ++i) {
+				x[i] += 2 * Normal(seed);
+				y[i] += 2 * Normal(seed);
+			}
+		}
+	}
+
+	void Likelihood(int begin, int end) {
+		float *x = getColumn(0), *y = getColumn(1);
+		double *weights = getWeights();
+		int N = getParticles();
+		for (int i = begin; i < end; ++i) {
+			int k = i / N;
+			double dx = x[i] - target_x[k], dy = y[i] - target_y[k];
+			weights[i] = std::exp(-(dx * dx + dy * dy) / 8);
+		}
+	}
+};
+
+/**
+ * Run the same bank without a pool, with a single worker and with several workers. The filters are cut in
+ * several pieces, and every filter draws from its own generator, so the particles should be identical.
+ */
+void test_filter_bank_pool() {
+	cout << " === start test filter bank pool === " << endl;
+
+	int filters = 200, particles = 100, ticks = 20;
+	WorkerPool one(1), several(4);
+	WorkerPool *pools[3] = { NULL, &one, &several };
+	std::vector<float> columns[3];
+	std::vector<double> means[3];
+	for (int p = 0; p < 3; ++p) {
+		srand48(1);
+		RandomWalkBank bank(filters, particles);
+		bank.SetWorkerPool(pools[p]);
+		for (int k = 0; k < filters; ++k) {
+			float mean[2] = { k * 10.0f, 0 }, spread[2] = { 3, 3 };
+			bank.Init(k, mean, spread);
+			bank.target_x[k] = k * 10;
+			bank.target_y[k] = 0;
+		}
+		for (int t = 0; t < ticks; ++t) {
+			for (int k = 0; k < filters; ++k) {
+				bank.target_x[k] += 1;
+				bank.target_y[k] += 0.5;
+			}
+			bank.Tick();
+			for (int k = 0; k < filters; ++k) means[p].push_back(bank.GetMean(k, 0));
+		}
+		for (int d = 0; d < 2; ++d) {
+			columns[p].insert(columns[p].end(), bank.getColumn(d), bank.getColumn(d) + filters * particles);
+		}
+	}
+	assert (columns[1] == columns[0] && columns[2] == columns[0]);
+	assert (means[1] == means[0] && means[2] == means[0]);
+	cout << "Same particles and means without pool, with one and with four workers" << endl;
+
+	cout << " === end test filter bank pool === " << endl;
+}
+
+#endif /* TESTFILTERBANK_H_ */
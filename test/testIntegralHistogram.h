@@ -0,0 +1,104 @@
+/**
+ * @brief
+ * @file testIntegralHistogram.h
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+
+#ifndef TESTINTEGRALHISTOGRAM_H_
+#define TESTINTEGRALHISTOGRAM_H_
+
+#include <IntegralHistogram.h>
+#include <Histogram.h>
+#include <CImg.h>
+
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+using namespace cimg_library;
+using namespace std;
+
+/**
+ * The integral histogram should give exactly the same histogram as cropping the image and
+ * running a Histogram over it, also for rectangles that are (partly) outside of the image.
+ */
+void test_integral_histogram() {
+	cout << " === start test integral histogram === " << endl;
+
+	int bins = 16;
+	CImg<DataValue> img(40, 30, 1, 3);
+	for (int i = 0; i < (int)img.size(); ++i) {
+		img._data[i] = rand() % 256;
+	}
+
+	IntegralHistogram integral(bins);
+	integral.Update(img);
+
+	int rectangles[][4] = { {0, 0, 39, 29}, {5, 7, 12, 20}, {-4, -3, 6, 8}, {30, 25, 45, 35}, {10, 10, 10, 10} };
+	for (int r = 0; r < 5; ++r) {
+		int *c = rectangles[r];
+		CImg<DataValue> img_selection = img.get_crop(c[0], c[1], c[2], c[3]);
+		Histogram histogram(bins, img_selection._width, img_selection._height);
+		DataFrames frames;
+		frames.push_back(img_selection._data);
+		histogram.calcProbabilities(frames);
+		NormalizedHistogramValues expected, result;
+		histogram.getProbabilities(expected);
+		integral.getProbabilities(c[0], c[1], c[2], c[3], result);
+		for (int b = 0; b < bins; ++b) {
+			assert (std::abs(expected[b] - result[b]) < 1e-6);
+		}
+		cout << "Rectangle [" << c[0] << ',' << c[1] << ',' << c[2] << ',' << c[3] << "] matches" << endl;
+	}
+
+	// a kernel-weighted histogram is still normalized, and a uniform image gives a single bin
+	NormalizedHistogramValues result;
+	integral.getKernelProbabilities(5, 7, 24, 22, 4, result);
+	Value sum = 0;
+	for (int b = 0; b < bins; ++b) sum += result[b];
+	cout << "Kernel-weighted histogram sums to " << sum << endl;
+	assert (std::abs(sum - 1) < 1e-4);
+
+	KernelTile scratch;
+	const KernelTile & tile = integral.getKernelTile(20, 16, 4, scratch);
+	assert (&tile != &scratch);
+	cout << "Kernel coefficients (inner to outer): ";
+	for (int l = 0; l < 4; ++l) cout << tile.coefficient[l] << ' ';
+	cout << endl;
+
+	// more sizes than slots in the cache, the tiles that do not fit are calculated per query
+	for (int size = 4; size < 4 + 2 * KERNEL_TILE_SLOTS; ++size) {
+		integral.getKernelProbabilities(0, 0, size - 1, size / 2, 4, result);
+		sum = 0;
+		for (int b = 0; b < bins; ++b) sum += result[b];
+		assert (std::abs(sum - 1) < 1e-4);
+	}
+
+	CImg<DataValue> uniform(20, 20, 1, 1, 200);
+	integral.Update(uniform);
+	integral.getKernelProbabilities(2, 2, 17, 17, 3, result);
+	assert (std::abs(result[(200 * bins) >> 8] - 1) < 1e-4);
+
+	cout << " === end test integral histogram === " << endl;
+}
+
+#endif /* TESTINTEGRALHISTOGRAM_H_ */
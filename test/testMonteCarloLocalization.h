@@ -0,0 +1,168 @@
+/**
+ * @brief
+ * @file testMonteCarloLocalization.h
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+
+
+#ifndef TESTMONTECARLOLOCALIZATION_H_
+#define TESTMONTECARLOLOCALIZATION_H_
+
+#include <MonteCarloLocalization.h>
+#include <OccupancyGrid.h>
+
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+using namespace std;
+
+//! Resolution of the test map in meters
+static const Value mcl_resolution = 0.1;
+
+//! Maximum range of the simulated scanner in meters
+static const Value mcl_max_range = 5;
+
+//! Number of beams of the simulated scanner, evenly spread over a full circle
+#define MCL_BEAMS 60
+
+/**
+ * A room of 10 by 8 meters with a wall halfway that leaves a passage at the top, a second wall and a
+ * pillar. The room is not symmetric, so a scan determines the pose.
+ */
+void create_mcl_map(OccupancyGrid & map) {
+	int width = map.getWidth(), height = map.getHeight();
+	for (int x = 0; x < width; ++x) {
+		map.setCell(x, 0, CS_OCCUPIED);
+		map.setCell(x, height - 1, CS_OCCUPIED);
+	}
+	for (int y = 0; y < height; ++y) {
+		map.setCell(0, y, CS_OCCUPIED);
+		map.setCell(width - 1, y, CS_OCCUPIED);
+	}
+	for (int y = 0; y < 50; ++y) map.setCell(40, y, CS_OCCUPIED);
+	for (int x = 60; x < 90; ++x) map.setCell(x, 55, CS_OCCUPIED);
+	for (int y = 20; y < 30; ++y) {
+		for (int x = 70; x < 75; ++x) map.setCell(x, y, CS_OCCUPIED);
+	}
+}
+
+//! The range of a beam by stepping along it until an occupied cell
+Value cast_beam(OccupancyGrid & map, Value x, Value y, Value angle) {
+	for (Value r = 0; r < mcl_max_range; r += 0.02) {
+		int cx = (int)((x + r * std::cos(angle)) / mcl_resolution);
+		int cy = (int)((y + r * std::sin(angle)) / mcl_resolution);
+		if (cx < 0 || cy < 0 || cx >= map.getWidth() || cy >= map.getHeight()) return mcl_max_range;
+		if (map.getCell(cx, cy) == CS_OCCUPIED) return r;
+	}
+	return mcl_max_range;
+}
+
+/**
+ * Drive the robot from (2,2) along a wavy path and localize it. Returns the mean position error over the
+ * last ten updates.
+ * @param global			start with the particles spread over the map instead of around the true pose
+ */
+double run_mcl(OccupancyGrid & map, int particles, bool global) {
+	MonteCarloLocalization mcl(map, particles);
+	Value angles[MCL_BEAMS];
+	for (int b = 0; b < MCL_BEAMS; ++b) angles[b] = -M_PI + 2 * M_PI * b / MCL_BEAMS;
+	mcl.SetSensor(angles, MCL_BEAMS, mcl_max_range, 2);
+	mcl.SetMotionNoise(0.05, 0.05);
+	Value x = 2, y = 2, theta = 0;
+	if (global) {
+		mcl.InitGlobal();
+	} else {
+		mcl.InitPose(x, y, theta, 0.3, 0.3);
+	}
+	Value ranges[MCL_BEAMS];
+	int steps = 60;
+	double error = 0;
+	for (int t = 0; t < steps; ++t) {
+		Value dx = 0.1, dtheta = (t % 20 < 10) ? 0.05 : -0.03;
+		x += dx * std::cos(theta);
+		y += dx * std::sin(theta);
+		theta += dtheta;
+		for (int b = 0; b < MCL_BEAMS; ++b) ranges[b] = cast_beam(map, x, y, theta + angles[b]);
+		mcl.Update(dx, 0, dtheta, ranges);
+		Value ex, ey, etheta;
+		mcl.GetPose(ex, ey, etheta);
+		if (t >= steps - 10) error += std::sqrt((ex - x) * (ex - x) + (ey - y) * (ey - y));
+	}
+	return error / 10;
+}
+
+/**
+ * The exact Euclidean distance transform against the distance to the nearest occupied cell by brute
+ * force, on a subset of the cells.
+ */
+void test_mcl_distance_transform() {
+	cout << " === start test mcl distance transform === " << endl;
+
+	OccupancyGrid map(100, 80, mcl_resolution);
+	create_mcl_map(map);
+	map.CalcLikelihoodField(0.1, 0.9, 0.1, mcl_max_range);
+	double max_error = 0;
+	for (int y = 0; y < map.getHeight(); y += 3) {
+		for (int x = 0; x < map.getWidth(); x += 3) {
+			double best = 1e9;
+			for (int v = 0; v < map.getHeight(); ++v) {
+				for (int u = 0; u < map.getWidth(); ++u) {
+					if (map.getCell(u, v) != CS_OCCUPIED) continue;
+					best = std::min(best, std::sqrt(double((u - x) * (u - x) + (v - y) * (v - y))));
+				}
+			}
+			max_error = std::max(max_error, std::fabs(best * mcl_resolution - map.getDistance(x, y)));
+		}
+	}
+	cout << "Max error of the distance transform " << max_error << " m" << endl;
+	assert (max_error < 1e-4);
+
+	cout << " === end test mcl distance transform === " << endl;
+}
+
+/**
+ * Tracking from a known pose, and global localization with the particles spread over all free cells. The
+ * likelihood field is smoother (sigma 0.3 m) for global localization, so particles far from the true
+ * pose still see a gradient.
+ */
+void test_mcl_localization() {
+	cout << " === start test mcl localization === " << endl;
+
+	OccupancyGrid map(100, 80, mcl_resolution);
+	create_mcl_map(map);
+	srand48(4);
+	map.CalcLikelihoodField(0.1, 0.9, 0.1, mcl_max_range);
+	double tracking = run_mcl(map, 20000, false);
+	cout << "Tracking from a known pose: mean error " << tracking << " m" << endl;
+	assert (tracking < 0.05);
+
+	srand48(4);
+	map.CalcLikelihoodField(0.3, 0.9, 0.1, mcl_max_range);
+	double global = run_mcl(map, 20000, true);
+	cout << "Global localization: mean error " << global << " m" << endl;
+	assert (global < 0.1);
+
+	cout << " === end test mcl localization === " << endl;
+}
+
+#endif /* TESTMONTECARLOLOCALIZATION_H_ */
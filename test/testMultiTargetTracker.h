@@ -0,0 +1,192 @@
+/**
+ * @brief
+ * @file testMultiTargetTracker.h
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+
+
+#ifndef TESTMULTITARGETTRACKER_H_
+#define TESTMULTITARGETTRACKER_H_
+
+#include <MultiTargetTracker.h>
+#include <CImg.h>
+
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+using namespace cimg_library;
+using namespace std;
+
+//! A filter of which the particles can be placed and the weights read
+class InteractionProbeFilter: public PositionParticleFilter {
+public:
+	//! Spread the particles uniformly around (x,y) with weight one
+	void Place(Value x, Value y, Value spread) {
+		for (size_t i = 0; i < getParticles().size(); ++i) {
+			ParticleState *state = getParticles()[i]->getState();
+			state->x[0] = x + spread * (2 * drand48() - 1);
+			state->y[0] = y + spread * (2 * drand48() - 1);
+			getParticles()[i]->setWeight(1);
+		}
+	}
+
+	Value GetWeight(int i) { return getParticles()[i]->getWeight(); }
+};
+
+//! A tracker that runs the interaction on its own
+class InteractionProbeTracker: public MultiTargetTracker {
+public:
+	void Interact(std::vector<PositionParticleFilter*> & targets) { MultiTargetTracker::Interact(targets); }
+};
+
+/**
+ * Compare the factors of the interaction on the grid with the brute-force sum over all pairs of particles
+ * of different targets. Three targets are placed each in their own grid cell, two pairs are within the
+ * radius. If the particles of a target coincide, the centroid of a cell is exact. If they are spread out,
+ * the grid misses the variance within a cell, which is small with respect to r^2.
+ */
+void test_multi_target_interaction() {
+	cout << " === start test multi target interaction === " << endl;
+
+	int particles = 50, targets = 3;
+	Value strength = 1, radius = 20;
+	Value centre_x[3] = { 115, 125, 105 }, centre_y[3] = { 85, 95, 75 };
+	Value spreads[2] = { 0, 2 }, tolerances[2] = { 1e-4, 0.05 };
+	srand48(1);
+	CImg<DataValue> img(240, 160, 1, 3, 100);
+	InteractionProbeTracker tracker;
+	tracker.SetInteraction(strength, radius);
+	tracker.SetFrame(img);
+	std::vector<PositionParticleFilter*> filters;
+	std::vector<InteractionProbeFilter*> probes;
+	for (int k = 0; k < targets; ++k) {
+		InteractionProbeFilter *probe = new InteractionProbeFilter();
+		CImg<CoordValue> coords(6);
+		coords(0) = centre_x[k] - 10; coords(1) = centre_y[k] - 15;
+		coords(3) = centre_x[k] + 9; coords(4) = centre_y[k] + 14;
+		tracker.AddTarget(probe, coords, particles);
+		probes.push_back(probe);
+		filters.push_back(probe);
+	}
+
+	std::vector<Value> x(targets * particles), y(targets * particles);
+	for (int s = 0; s < 2; ++s) {
+		for (int k = 0; k < targets; ++k) {
+			probes[k]->Place(centre_x[k], centre_y[k], spreads[s]);
+			probes[k]->GetPositions(&x[k * particles], &y[k * particles]);
+		}
+		tracker.Interact(filters);
+		Value max_error = 0, max_sum = 0;
+		for (int k = 0; k < targets; ++k) {
+			for (int p = k * particles; p < (k + 1) * particles; ++p) {
+				Value sum = 0;
+				for (int q = 0; q < targets * particles; ++q) {
+					if (q / particles == k) continue;
+					Value dx = x[q] - x[p], dy = y[q] - y[p];
+					Value d2 = (dx * dx + dy * dy) / (radius * radius);
+					if (d2 < 1) sum += (1 - d2) / particles;
+				}
+				Value grid = -std::log(probes[k]->GetWeight(p - k * particles)) / strength;
+				max_error = std::max(max_error, std::fabs(grid - sum));
+				max_sum = std::max(max_sum, sum);
+			}
+		}
+		cout << "Spread " << spreads[s] << ": largest repulsion " << max_sum << ", max error of the grid " << max_error << endl;
+		assert (max_sum > 0.5);
+		assert (max_error < tolerances[s]);
+	}
+
+	cout << " === end test multi target interaction === " << endl;
+}
+
+/**
+ * A frame with two boxes of 20x30 pixels on a grey checkerboard, both red but with a slightly different
+ * green component, so their histograms are nearly the same.
+ */
+void draw_crossing_frame(CImg<DataValue> & img, const int *x, const int *y) {
+	for (int j = 0; j < (int)img._height; ++j) {
+		for (int i = 0; i < (int)img._width; ++i) {
+			DataValue v = ((i / 10 + j / 10) % 2) ? 40 : 90;
+			img(i, j, 0, 0) = img(i, j, 0, 1) = img(i, j, 0, 2) = v;
+		}
+	}
+	for (int k = 0; k < 2; ++k) {
+		for (int j = y[k]; j < y[k] + 30; ++j) {
+			for (int i = x[k]; i < x[k] + 20; ++i) {
+				img(i, j, 0, 0) = 250;
+				img(i, j, 0, 1) = k ? 30 : 20;
+				img(i, j, 0, 2) = 20;
+			}
+		}
+	}
+}
+
+/**
+ * Two look-alike boxes cross each other horizontally. Independent filters tend to both end on the same box
+ * (over 10 seeds 4 of the 20 tracks are lost), the repulsion keeps them apart.
+ */
+void test_multi_target_crossing() {
+	cout << " === start test multi target crossing === " << endl;
+
+	int runs = 10, particles = 300, frames = 40;
+	Value strengths[2] = { 0, 5 };
+	int lost[2] = { 0, 0 };
+	for (int s = 0; s < 2; ++s) {
+		for (int run = 0; run < runs; ++run) {
+			srand48(run + 1);
+			MultiTargetTracker tracker;
+			tracker.SetInteraction(strengths[s]);
+			int x[2] = { 40, 160 }, y[2] = { 40, 50 };
+			CImg<DataValue> img(240, 160, 1, 3);
+			draw_crossing_frame(img, x, y);
+			tracker.SetFrame(img);
+			std::streambuf *buffer = cout.rdbuf(0);
+			for (int k = 0; k < 2; ++k) {
+				CImg<CoordValue> coords(6);
+				coords(0) = x[k]; coords(1) = y[k]; coords(3) = x[k] + 19; coords(4) = y[k] + 29;
+				tracker.AddTarget(coords, particles);
+			}
+			for (int t = 1; t <= frames; ++t) {
+				x[0] += 3;
+				x[1] -= 3;
+				draw_crossing_frame(img, x, y);
+				tracker.Tick(&img);
+			}
+			cout.rdbuf(buffer);
+			for (int k = 0; k < 2; ++k) {
+				RegionEstimate estimate;
+				tracker.GetTarget(k).GetMeanEstimate(estimate);
+				if (std::sqrt(std::pow(double(estimate.x0 - x[k]), 2) + std::pow(double(estimate.y0 - y[k]), 2)) > 20) {
+					lost[s]++;
+				}
+			}
+		}
+		cout << "Strength " << strengths[s] << ": lost " << lost[s] << " of " << 2 * runs << " tracks" << endl;
+	}
+	assert (lost[1] < lost[0]);
+
+	cout << " === end test multi target crossing === " << endl;
+}
+
+#endif /* TESTMULTITARGETTRACKER_H_ */
@@ -0,0 +1,184 @@
+/**
+ * @brief
+ * @file testOfflineSmoother.h
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+
+
+#ifndef TESTOFFLINESMOOTHER_H_
+#define TESTOFFLINESMOOTHER_H_
+
+#include <OfflineSmoother.hpp>
+
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+//! A scalar state
+struct ScalarSnapshot {
+	double x;
+};
+
+//! A random walk with standard deviation sigma, divided by its supremum
+struct ScalarTransitionKernel {
+	ScalarTransitionKernel(double sigma): inv_two_variance(1 / (2 * sigma * sigma)) {}
+	double operator()(const ScalarSnapshot & from, const ScalarSnapshot & to) {
+		double d = to.x - from.x;
+		return std::exp(-d * d * inv_two_variance);
+	}
+	double inv_two_variance;
+};
+
+/**
+ * Fill the smoother with a random walk observed with noise: per frame the particles are spread around the
+ * observation and weighted by the observation likelihood.
+ */
+void fill_scalar_smoother(OfflineSmoother<ScalarSnapshot> & smoother, int frames, double sigma) {
+	int particles = smoother.getParticles();
+	std::vector<double> weights(particles);
+	double truth = 0;
+	for (int t = 0; t < frames; ++t) {
+		truth += sigma * (2 * drand48() - 1);
+		bool reserved = smoother.Next();
+		assert (reserved);
+		double sum = 0;
+		for (int i = 0; i < particles; ++i) {
+			weights[i] = 0.1 + drand48();
+			sum += weights[i];
+		}
+		for (int i = 0; i < particles; ++i) {
+			ScalarSnapshot snapshot;
+			snapshot.x = truth + 2 * sigma * (2 * drand48() - 1) + 0.01 * i;
+			smoother.Set(i, snapshot, weights[i] / sum);
+		}
+	}
+}
+
+/**
+ * The marginal smoothing distribution over the particles of a frame with the exact O(N^2) backward
+ * recursion: the smoothing weight of particle i at time t is w[t]_i sum_j s[t+1]_j f(x[t+1]_j | x[t]_i) /
+ * sum_k w[t]_k f(x[t+1]_j | x[t]_k).
+ */
+void exact_marginal(OfflineSmoother<ScalarSnapshot> & smoother, ScalarTransitionKernel & kernel, int frame,
+		std::vector<double> & marginal) {
+	int particles = smoother.getParticles();
+	int t = smoother.getFrames() - 1;
+	marginal.resize(particles);
+	for (int i = 0; i < particles; ++i) marginal[i] = smoother.getWeight(t, i);
+	std::vector<double> next(particles), normalization(particles);
+	for (--t; t >= frame; --t) {
+		next.swap(marginal);
+		for (int j = 0; j < particles; ++j) {
+			normalization[j] = 0;
+			for (int k = 0; k < particles; ++k) {
+				normalization[j] += smoother.getWeight(t, k) *
+						kernel(smoother.getSnapshot(t, k), smoother.getSnapshot(t + 1, j));
+			}
+		}
+		for (int i = 0; i < particles; ++i) {
+			double sum = 0;
+			for (int j = 0; j < particles; ++j) {
+				sum += next[j] * kernel(smoother.getSnapshot(t, i), smoother.getSnapshot(t + 1, j)) / normalization[j];
+			}
+			marginal[i] = smoother.getWeight(t, i) * sum;
+		}
+	}
+}
+
+/**
+ * Draw many trajectories with rejection sampling and compare how often each particle of the first frame
+ * is visited with the exact marginal smoothing distribution. The same is done with max_trials zero, so
+ * every step uses the exact backward kernel.
+ */
+void test_offline_smoother_exact() {
+	cout << " === start test offline smoother exact === " << endl;
+
+	int particles = 20, frames = 4, trajectories = 200000;
+	double sigma = 1;
+	srand48(1);
+	OfflineSmoother<ScalarSnapshot> smoother;
+	smoother.Configure(particles);
+	fill_scalar_smoother(smoother, frames, sigma);
+	ScalarTransitionKernel kernel(sigma);
+	std::vector<double> marginal;
+	exact_marginal(smoother, kernel, 0, marginal);
+
+	int max_trials[2] = { 32, 0 };
+	for (int m = 0; m < 2; ++m) {
+		smoother.Smooth(trajectories, kernel, max_trials[m]);
+		std::vector<double> visits(particles, 0);
+		for (int j = 0; j < trajectories; ++j) visits[smoother.getIndex(j, 0)] += 1.0 / trajectories;
+		double max_error = 0;
+		for (int i = 0; i < particles; ++i) {
+			max_error = std::max(max_error, std::fabs(visits[i] - marginal[i]));
+		}
+		cout << "Max trials " << max_trials[m] << ": " << smoother.getTrials() << " trials, ";
+		cout << smoother.getFallbacks() << " fallbacks, max error of the marginal " << max_error << endl;
+		assert (max_error < 0.01);
+	}
+
+	cout << " === end test offline smoother exact === " << endl;
+}
+
+/**
+ * With a memory limit that holds only the first block of frames, the storage moves to a mapped file while
+ * the sequence grows. The frames stored before and after the move should be intact and can be smoothed.
+ */
+void test_offline_smoother_mapped() {
+	cout << " === start test offline smoother mapped === " << endl;
+
+	int particles = 10, frames = 100;
+	size_t limit = 16 * particles * sizeof(OfflineSmoother<ScalarSnapshot>::Entry);
+	OfflineSmoother<ScalarSnapshot> smoother;
+	smoother.Configure(particles, limit);
+	for (int t = 0; t < frames; ++t) {
+		bool reserved = smoother.Next();
+		assert (reserved);
+		for (int i = 0; i < particles; ++i) {
+			ScalarSnapshot snapshot;
+			snapshot.x = t + 0.01 * i;
+			smoother.Set(i, snapshot, 1.0 / particles);
+		}
+		assert (smoother.isMapped() == (t >= 16));
+	}
+	for (int t = 0; t < frames; ++t) {
+		for (int i = 0; i < particles; ++i) {
+			assert (smoother.getSnapshot(t, i).x == t + 0.01 * i);
+			assert (smoother.getWeight(t, i) == 1.0 / particles);
+		}
+	}
+	ScalarTransitionKernel kernel(1);
+	smoother.Smooth(10, kernel);
+	for (int j = 0; j < 10; ++j) {
+		for (int t = 0; t < frames; ++t) {
+			assert (std::floor(smoother.getSmoothed(j, t).x + 0.5) == t);
+		}
+	}
+	cout << "Stored " << frames << " frames, " << smoother.getMemoryFootprint() << " bytes mapped" << endl;
+
+	cout << " === end test offline smoother mapped === " << endl;
+}
+
+#endif /* TESTOFFLINESMOOTHER_H_ */
@@ -0,0 +1,536 @@
+/**
+ * @brief
+ * @file testPositionParticleFilter.h
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+
+
+#ifndef TESTPOSITIONPARTICLEFILTER_H_
+#define TESTPOSITIONPARTICLEFILTER_H_
+
+#include <PositionParticleFilter.h>
+#include <RBPositionParticleFilter.h>
+#include <IntegralHistogram.h>
+#include <Container.hpp>
+#include <CImg.h>
+
+#include <testQuasiMonteCarlo.h>
+
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+using namespace cimg_library;
+using namespace std;
+
+//! A filter of which the particles and the likelihood of single states can be inspected
+class ProbeParticleFilter: public PositionParticleFilter {
+public:
+	//! The likelihood of the first particle moved to (x,y)
+	Value LikelihoodAt(Value x, Value y) {
+		ParticleState state(*getParticles()[0]->getState());
+		state.x[0] = x;
+		state.y[0] = y;
+		return Likelihood(state);
+	}
+
+	//! The rectangle of the first particle moved to (x,y)
+	void RegionAt(Value x, Value y, CoordValue & x0, CoordValue & y0, CoordValue & x1, CoordValue & y1) {
+		GetRegion(*getParticles()[0]->getState(), x, y, x0, y0, x1, y1);
+	}
+
+	//! The state of a particle
+	ParticleState & State(int i) { return *getParticles()[i]->getState(); }
+
+	//! Place a particle at (x,y) at rest with the given weight
+	void Place(int i, Value x, Value y, Value weight) {
+		std::fill(State(i).x.begin(), State(i).x.end(), x);
+		std::fill(State(i).y.begin(), State(i).y.end(), y);
+		getParticles()[i]->setWeight(weight);
+	}
+
+	//! Resample and jitter the particles
+	void RunRegularize() { Regularize(); }
+
+	//! Move the first particle to (x,y) with zero velocity and refine it with mean shift
+	void MeanShiftAt(Value x, Value y, int iterations) {
+		ParticleState & state = State(0);
+		std::fill(state.x.begin(), state.x.end(), x);
+		std::fill(state.y.begin(), state.y.end(), y);
+		NormalizedHistogramValues target;
+		GetMeanShiftTarget(target);
+		MeanShift(state, target, iterations);
+	}
+};
+
+//! Initialize a filter on the box of the synthetic sequence with its top-left corner at (x,y)
+void init_synthetic_filter(PositionParticleFilter & filter, CImg<DataValue> & img, int x, int y, int particles) {
+	draw_synthetic_frame(img, x, y);
+	CImg<CoordValue> coords(6);
+	coords(0) = x; coords(1) = y; coords(3) = x + 19; coords(4) = y + 29;
+	filter.Init(img, coords, particles);
+}
+
+/**
+ * A stage with 4 bins in front of the full histogram. Over a grid of positions, a position at which the
+ * 4-bin likelihood (calculated here from an integral histogram of its own) is below the threshold should
+ * get exactly that likelihood, the others at most that likelihood. The counters should count every
+ * position, and every particle of a tick, and accumulate over ticks until they are reset.
+ */
+void test_cascade() {
+	cout << " === start test cascade === " << endl;
+
+	int particles = 200, bins = 4;
+	Value threshold = 0.01;
+	srand48(1);
+	CImg<DataValue> img(200, 120, 1, 3);
+	int x = 60, y = 40;
+	ProbeParticleFilter filter;
+	std::streambuf *buffer = cout.rdbuf(0);
+	init_synthetic_filter(filter, img, x, y, particles);
+	cout.rdbuf(buffer);
+	filter.AddCascadeStage(bins, threshold);
+
+	IntegralHistogram coarse(bins);
+	coarse.Update(img);
+	const NormalizedHistogramValues & model = filter.GetModel();
+	NormalizedHistogramValues reference(bins, Value(0)), observed;
+	for (size_t i = 0; i < model.size(); ++i) reference[i / (model.size() / bins)] += model[i];
+
+	long evaluated = 0, rejected = 0;
+	for (int j = 0; j < (int)img._height; j += 3) {
+		for (int i = 0; i < (int)img._width; i += 3) {
+			CoordValue x0, y0, x1, y1;
+			filter.RegionAt(i, j, x0, y0, x1, y1);
+			coarse.getProbabilities(x0, y0, x1, y1, observed);
+			Value stage = std::exp(-20 * dobots::distance<Value>(reference.begin(), reference.end(),
+					observed.begin(), observed.end(), dobots::DM_SQUARED_HELLINGER));
+			Value likelihood = filter.LikelihoodAt(i, j);
+			evaluated++;
+			if (stage < threshold) {
+				rejected++;
+				assert (std::fabs(likelihood - stage) < 1e-5);
+			} else {
+				assert (likelihood <= stage + 1e-5);
+			}
+		}
+	}
+	long counted_evaluated, counted_rejected;
+	filter.GetCascadeCounters(0, counted_evaluated, counted_rejected);
+	cout << "Rejected " << rejected << " of " << evaluated << " positions at the first stage" << endl;
+	assert (counted_evaluated == evaluated && counted_rejected == rejected);
+	assert (rejected > 0 && rejected < evaluated);
+
+	filter.ResetCascadeCounters();
+	buffer = cout.rdbuf(0);
+	for (int t = 1; t <= 2; ++t) {
+		draw_synthetic_frame(img, x + 2 * t, y);
+		filter.Tick(&img, 1);
+		filter.GetCascadeCounters(0, counted_evaluated, counted_rejected);
+		assert (counted_evaluated == t * particles);
+		assert (counted_rejected <= counted_evaluated);
+	}
+	cout.rdbuf(buffer);
+
+	cout << " === end test cascade === " << endl;
+}
+
+//! The synthetic frame, with other values for the red channel of the upper and lower half of the box
+void draw_synthetic_frame(CImg<DataValue> & img, int x, int y, DataValue upper, DataValue lower) {
+	draw_synthetic_frame(img, x, y);
+	for (int j = y; j < y + 30; ++j) {
+		for (int i = x; i < x + 20; ++i) {
+			img(i, j, 0, 0) = (j < y + 15) ? upper : lower;
+		}
+	}
+}
+
+/**
+ * The upper half of the box brightens from the tenth bin of the red channel to the fourteenth. The box still
+ * matches the model half, so the filter stays on it, and with the model update the reference histogram should
+ * move towards the brightened box. A box that is suddenly replaced by an occluder of another colour should
+ * not be learned, because the update would move the model too far from the initial one.
+ */
+void test_model_update() {
+	cout << " === start test model update === " << endl;
+
+	int particles = 200, x = 60, y = 40, frames = 10;
+	srand48(1);
+	CImg<DataValue> img(200, 120, 1, 3);
+	CImg<CoordValue> coords(6);
+	coords(0) = x; coords(1) = y; coords(3) = x + 19; coords(4) = y + 29;
+	ProbeParticleFilter filter;
+	filter.SetModelUpdate(0.3, 0, 0.5);
+	std::streambuf *buffer = cout.rdbuf(0);
+	draw_synthetic_frame(img, x, y, 170, 170);
+	filter.Init(img, coords, particles);
+	NormalizedHistogramValues initial = filter.GetModel();
+	for (int t = 1; t <= frames; ++t) {
+		draw_synthetic_frame(img, x, y, 220, 170);
+		filter.Tick(&img, 1);
+	}
+	cout.rdbuf(buffer);
+	IntegralHistogram observed_histogram(initial.size());
+	observed_histogram.Update(img);
+	NormalizedHistogramValues observed;
+	observed_histogram.getProbabilities(x, y, x + 19, y + 29, observed);
+	const NormalizedHistogramValues & model = filter.GetModel();
+	Value before = dobots::distance<Value>(initial.begin(), initial.end(), observed.begin(), observed.end(),
+			dobots::DM_SQUARED_HELLINGER);
+	Value after = dobots::distance<Value>(model.begin(), model.end(), observed.begin(), observed.end(),
+			dobots::DM_SQUARED_HELLINGER);
+	cout << "Mass of the model in the brightened bin " << model[(220 * model.size()) >> 8];
+	cout << ", distance to the box " << before << " -> " << after << endl;
+	assert (model[(220 * model.size()) >> 8] > 0.15);
+	assert (after < 0.8 * before);
+
+	ProbeParticleFilter occluded;
+	occluded.SetModelUpdate(0.5, 0, 0.1);
+	buffer = cout.rdbuf(0);
+	draw_synthetic_frame(img, x, y, 170, 170);
+	occluded.Init(img, coords, particles);
+	initial = occluded.GetModel();
+	for (int t = 1; t <= 3; ++t) {
+		draw_synthetic_frame(img, x, y, 0, 0);
+		occluded.Tick(&img, 1);
+	}
+	cout.rdbuf(buffer);
+	assert (occluded.GetModel() == initial);
+	cout << "Model unchanged behind the occluder" << endl;
+
+	cout << " === end test model update === " << endl;
+}
+
+/**
+ * A particle that starts next to the box at rest should be moved towards the box by mean shift. Only its
+ * current position is moved, so the shift becomes its velocity. Over a sequence in which the box moves at
+ * a constant velocity, the mean velocity of the particles should be that of the box. This is with enough
+ * iterations to reach the mode: if the history would be translated with the shift, the velocity would not
+ * be corrected by anything, and it ends up far from 3 pixels per frame (about -13 with this seed).
+ */
+void test_mean_shift() {
+	cout << " === start test mean shift === " << endl;
+
+	int particles = 50, x = 60, y = 40, frames = 30;
+	srand48(1);
+	CImg<DataValue> img(200, 120, 1, 3);
+	ProbeParticleFilter filter;
+	filter.SetMeanShift(10, 10);
+	std::streambuf *buffer = cout.rdbuf(0);
+	init_synthetic_filter(filter, img, x, y, particles);
+	cout.rdbuf(buffer);
+	Value start_x = x + 9 - 6, start_y = y + 14 + 4;
+	filter.MeanShiftAt(start_x, start_y, 10);
+	ParticleState & state = filter.State(0);
+	cout << "Mean shift from 6 pixels left and 4 below to [" << state.x[0] << ',' << state.y[0] << "], velocity [";
+	cout << state.x[0] - state.x[1] << ',' << state.y[0] - state.y[1] << "]" << endl;
+	Value dx = state.x[0] - (x + 9), dy = state.y[0] - (y + 14);
+	assert (dx * dx + dy * dy < (6 * 6 + 4 * 4) / 4);
+	assert (state.x[1] == start_x && state.y[1] == start_y);
+
+	buffer = cout.rdbuf(0);
+	init_synthetic_filter(filter, img, x, y, particles);
+	for (int t = 1; t <= frames; ++t) {
+		x += 3;
+		draw_synthetic_frame(img, x, y);
+		filter.Tick(&img, 1);
+	}
+	cout.rdbuf(buffer);
+	Value velocity = 0;
+	for (int i = 0; i < particles; ++i) velocity += (filter.State(i).x[0] - filter.State(i).x[1]) / particles;
+	cout << "Mean velocity of the particles " << velocity << " for a box moving 3 pixels per frame" << endl;
+	assert (std::fabs(velocity - 3) < 1);
+
+	cout << " === end test mean shift === " << endl;
+}
+
+//! A filter that records the exponent, whether it only diffuses, and the likelihood at a position per layer
+class AnnealingProbeFilter: public ProbeParticleFilter {
+public:
+	AnnealingProbeFilter(Value x, Value y): probe_x(x), probe_y(y) {}
+
+	void Likelihood() {
+		exponents.push_back(GetLikelihoodExponent());
+		diffusion.push_back(IsDiffusionOnly());
+		likelihoods.push_back(LikelihoodAt(probe_x, probe_y));
+		PositionParticleFilter::Likelihood();
+	}
+
+	Value probe_x, probe_y;
+	std::vector<Value> exponents, likelihoods;
+	std::vector<bool> diffusion;
+};
+
+/**
+ * Annealing with 4 layers and a rate of 0.5: the exponents of the layers should be 2.5, 5, 10 and 20, so
+ * the last layer has the normal exponent, and only the first layer uses the motion model. The likelihood
+ * at a position next to the box should follow the exponents: its logarithm scales with them.
+ */
+void test_annealing() {
+	cout << " === start test annealing === " << endl;
+
+	int particles = 100, layers = 4, x = 60, y = 40;
+	Value rate = 0.5;
+	srand48(1);
+	CImg<DataValue> img(200, 120, 1, 3);
+	AnnealingProbeFilter filter(x + 9 + 3, y + 14 + 2);
+	filter.SetAnnealing(rate);
+	std::streambuf *buffer = cout.rdbuf(0);
+	init_synthetic_filter(filter, img, x, y, particles);
+	for (int t = 1; t <= 2; ++t) {
+		draw_synthetic_frame(img, x + 2 * t, y);
+		filter.Tick(&img, layers);
+	}
+	cout.rdbuf(buffer);
+	assert ((int)filter.exponents.size() == 2 * layers);
+	for (size_t i = 0; i < filter.exponents.size(); ++i) {
+		int layer = i % layers;
+		Value expected = 20 * std::pow(rate, layers - 1 - layer);
+		cout << "Layer " << layer << ": exponent " << filter.exponents[i] << ", likelihood next to the box ";
+		cout << filter.likelihoods[i] << endl;
+		assert (std::fabs(filter.exponents[i] - expected) < 1e-4);
+		assert (filter.diffusion[i] == (layer > 0));
+		Value last = filter.likelihoods[i - layer + layers - 1];
+		assert (std::fabs(std::log(filter.likelihoods[i]) / std::log(last) - expected / 20) < 1e-3);
+	}
+	assert (filter.exponents.back() == 20);
+
+	cout << " === end test annealing === " << endl;
+}
+
+//! A Rao-Blackwellized filter of which the particles can be inspected
+class RBProbeParticleFilter: public RBPositionParticleFilter {
+public:
+	//! The state of a particle
+	ParticleState & State(int i) { return *getParticles()[i]->getState(); }
+};
+
+/**
+ * The variance of the velocity of the Rao-Blackwellized filter follows the Riccati recursion of the scalar
+ * Kalman filter, independent of the data. It converges to the steady state P that solves
+ *   P = (P + q) r / (P + q + r)
+ * which is P = S - q with S = (q + sqrt(q^2 + 4 q r)) / 2. The mean velocity of the particles should be
+ * that of the box, 3 pixels per frame to the right and at rest vertically.
+ */
+void test_rao_blackwellized() {
+	cout << " === start test rao blackwellized === " << endl;
+
+	int particles = 100, x = 40, y = 40, frames = 20;
+	Value position = 1, velocity = 0.5;
+	srand48(1);
+	CImg<DataValue> img(200, 120, 1, 3);
+	RBProbeParticleFilter filter;
+	filter.SetNoise(position, velocity, 4);
+	std::streambuf *buffer = cout.rdbuf(0);
+	init_synthetic_filter(filter, img, x, y, particles);
+	for (int t = 1; t <= frames; ++t) {
+		x += 3;
+		draw_synthetic_frame(img, x, y);
+		filter.Tick(&img, 1);
+	}
+	cout.rdbuf(buffer);
+	Value q = velocity * velocity, r = position * position;
+	Value steady = (q + std::sqrt(q * q + 4 * q * r)) / 2 - q;
+	Value mean[2] = { 0, 0 };
+	for (int i = 0; i < particles; ++i) {
+		for (int d = 0; d < 2; ++d) {
+			assert (std::fabs(filter.State(i).velocity_variance[d] - steady) < 1e-4);
+			mean[d] += filter.State(i).velocity[d] / particles;
+		}
+	}
+	cout << "Velocity variance " << filter.State(0).velocity_variance[0] << " (steady state " << steady << "), ";
+	cout << "mean velocity [" << mean[0] << ',' << mean[1] << "]" << endl;
+	assert (std::fabs(mean[0] - 3) < 1 && std::fabs(mean[1]) < 1);
+
+	cout << " === end test rao blackwellized === " << endl;
+}
+
+/**
+ * Track the box of the synthetic sequence, which moves 2 pixels per frame, with the mode switch, and return
+ * the first tick after which the filter is in single mode (0 if never).
+ */
+int first_single_mode(ProbeParticleFilter & filter, int frames, int ticks) {
+	int particles = 200, x = 60, y = 40;
+	srand48(1);
+	CImg<DataValue> img(200, 120, 1, 3);
+	filter.SetModeSwitch(frames, 5, 0.1, 0.01);
+	std::streambuf *buffer = cout.rdbuf(0);
+	init_synthetic_filter(filter, img, x, y, particles);
+	int first = 0;
+	for (int t = 1; t <= ticks && !first; ++t) {
+		draw_synthetic_frame(img, x + 2 * t, y);
+		filter.Tick(&img, 1);
+		if (filter.GetMode() == TM_SINGLE) first = t;
+	}
+	cout.rdbuf(buffer);
+	return first;
+}
+
+/**
+ * The switch to a single hypothesis needs "frames" unimodal frames in a row: with the same seed, the cloud
+ * is the same up to the switch, so asking for three more frames should delay it by three frames. Then the
+ * box jumps away, the single hypothesis no longer matches and the cloud is used again. In that frame the
+ * single hypothesis has been moved once, and all particles should be copies of it: the position before the
+ * jump is the previous entry in their history, it should not have been moved again by the transition.
+ */
+void test_mode_switch() {
+	cout << " === start test mode switch === " << endl;
+
+	ProbeParticleFilter early, late;
+	int first_early = first_single_mode(early, 3, 30), first_late = first_single_mode(late, 6, 30);
+	cout << "Single mode after " << first_early << " frames with 3 unimodal frames required, after " << first_late;
+	cout << " frames with 6" << endl;
+	assert (first_early >= 3);
+	assert (first_late == first_early + 3);
+
+	CImg<DataValue> img(200, 120, 1, 3);
+	ParticleState before(late.State(0));
+	draw_synthetic_frame(img, 150, 80);
+	std::streambuf *buffer = cout.rdbuf(0);
+	late.Tick(&img, 1);
+	cout.rdbuf(buffer);
+	assert (late.GetMode() == TM_PARTICLES);
+	ParticleState & single = late.State(0);
+	cout << "Single hypothesis moved from [" << before.x[0] << ',' << before.y[0] << "] to [" << single.x[0] << ',';
+	cout << single.y[0] << "] and degraded" << endl;
+	for (int i = 0; i < late.GetParticleCount(); ++i) {
+		ParticleState & state = late.State(i);
+		assert (state.x[1] == before.x[0] && state.y[1] == before.y[0]);
+		assert (state.x[0] == single.x[0] && state.y[0] == single.y[0]);
+	}
+
+	cout << " === end test mode switch === " << endl;
+}
+
+//! A filter that records the smallest and largest weight after the compensation for the first stage
+class AuxiliaryProbeFilter: public ProbeParticleFilter {
+public:
+	AuxiliaryProbeFilter(): smallest(1e30), largest(0) {}
+
+	void Likelihood() {
+		PositionParticleFilter::Likelihood();
+		for (int i = 0; i < GetParticleCount(); ++i) {
+			Value weight = getParticles()[i]->getWeight() / State(i).first_stage;
+			smallest = std::min(smallest, weight);
+			largest = std::max(largest, weight);
+		}
+	}
+
+	Value smallest, largest;
+};
+
+/**
+ * The auxiliary particle filter on a box that jumps back and forth. The weights after the compensation
+ * for the first stage (the full likelihood divided by the first-stage likelihood) should be finite and
+ * positive for every particle, and so should the sum of the weights at resampling.
+ */
+void test_auxiliary() {
+	cout << " === start test auxiliary === " << endl;
+
+	int particles = 100, x = 60, y = 40, frames = 20;
+	srand48(1);
+	CImg<DataValue> img(200, 120, 1, 3);
+	AuxiliaryProbeFilter filter;
+	filter.SetAuxiliary(true, 4);
+	std::streambuf *buffer = cout.rdbuf(0);
+	init_synthetic_filter(filter, img, x, y, particles);
+	for (int t = 1; t <= frames; ++t) {
+		x += (t % 2) ? 8 : -4;
+		draw_synthetic_frame(img, x, y);
+		filter.Tick(&img, 1);
+		const ParticleEstimate & estimate = filter.GetEstimate();
+		assert (estimate.total > 0 && estimate.total < 1e30);
+		assert (estimate.ess > 0);
+	}
+	cout.rdbuf(buffer);
+	cout << "Compensated weights between " << filter.smallest << " and " << filter.largest << endl;
+	assert (filter.smallest > 0 && filter.largest < 1e30);
+
+	cout << " === end test auxiliary === " << endl;
+}
+
+/**
+ * Regularization of a correlated Gaussian cloud with random weights. The jitter is drawn from a kernel
+ * with covariance h^2 S, with S the weighted covariance before resampling and h the factor times the
+ * optimal bandwidth N^(-1/6), so the covariance of the jittered cloud should be (1 + h^2) S. The history
+ * moves along, so the particles stay at rest.
+ */
+void test_regularization() {
+	cout << " === start test regularization === " << endl;
+
+	int particles = 20000, x = 60, y = 40;
+	Value factor = 3;
+	srand48(1);
+	CImg<DataValue> img(200, 120, 1, 3);
+	ProbeParticleFilter filter;
+	filter.SetRegularization(factor);
+	std::streambuf *buffer = cout.rdbuf(0);
+	init_synthetic_filter(filter, img, x, y, particles);
+	cout.rdbuf(buffer);
+	double sum = 0, mean[2] = { 0, 0 }, before[3] = { 0, 0, 0 };
+	std::vector<Value> px(particles), py(particles), weights(particles);
+	for (int i = 0; i < particles; ++i) {
+		double u0 = std::max(drand48(), 1e-12), u1 = drand48();
+		double e0 = std::sqrt(-2 * std::log(u0)) * std::cos(2 * M_PI * u1);
+		double e1 = std::sqrt(-2 * std::log(u0)) * std::sin(2 * M_PI * u1);
+		px[i] = 100 + 6 * e0;
+		py[i] = 60 + 2 * e0 + 3 * e1;
+		weights[i] = 1 + drand48();
+		filter.Place(i, px[i], py[i], weights[i]);
+		sum += weights[i];
+		mean[0] += weights[i] * px[i];
+		mean[1] += weights[i] * py[i];
+	}
+	mean[0] /= sum;
+	mean[1] /= sum;
+	for (int i = 0; i < particles; ++i) {
+		Value dx = px[i] - mean[0], dy = py[i] - mean[1];
+		before[0] += weights[i] * dx * dx / sum;
+		before[1] += weights[i] * dx * dy / sum;
+		before[2] += weights[i] * dy * dy / sum;
+	}
+	filter.RunRegularize();
+
+	double after_mean[2] = { 0, 0 }, after[3] = { 0, 0, 0 };
+	for (int i = 0; i < particles; ++i) {
+		after_mean[0] += filter.State(i).x[0] / particles;
+		after_mean[1] += filter.State(i).y[0] / particles;
+		assert (filter.State(i).x[0] == filter.State(i).x[1] && filter.State(i).y[0] == filter.State(i).y[1]);
+	}
+	for (int i = 0; i < particles; ++i) {
+		Value dx = filter.State(i).x[0] - after_mean[0], dy = filter.State(i).y[0] - after_mean[1];
+		after[0] += dx * dx / particles;
+		after[1] += dx * dy / particles;
+		after[2] += dy * dy / particles;
+	}
+	double h = factor * std::pow((double)particles, -1.0 / 6.0);
+	cout << "Bandwidth " << h << ", covariance (xx xy yy) before " << before[0] << ' ' << before[1] << ' ' << before[2];
+	cout << ", after " << after[0] << ' ' << after[1] << ' ' << after[2] << endl;
+	for (int c = 0; c < 3; ++c) {
+		assert (std::fabs(after[c] - (1 + h * h) * before[c]) < 0.05 * (1 + h * h) * before[c]);
+	}
+
+	cout << " === end test regularization === " << endl;
+}
+
+#endif /* TESTPOSITIONPARTICLEFILTER_H_ */
@@ -0,0 +1,233 @@
+/**
+ * @brief
+ * @file testVectorFilter.h
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    modular robotics / sensor fusion
+ */
+
+
+
+#ifndef TESTVECTORFILTER_H_
+#define TESTVECTORFILTER_H_
+
+#include <ParticleFilter.hpp>
+#include <VectorParticleFilter.hpp>
+
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+
+using namespace std;
+
+/**
+ * A robot at (x,y) with velocity (vx,vy) that observes a noisy position. The same model is run on the
+ * pointer-based ParticleFilter and on the VectorParticleFilter.
+ */
+struct RobotState {
+	double x[4];
+};
+
+//! Standard deviation of the acceleration and of the observed position
+static const double robot_noise = 0.5, robot_observation = 2.0;
+
+//! The robot model on the pointer-based core, one state object and virtual calls per particle
+class RobotParticleFilter: public ParticleFilter<RobotState> {
+public:
+	RobotParticleFilter(int particles) {
+		for (int i = 0; i < particles; ++i) {
+			RobotState *s = new RobotState();
+			for (int d = 0; d < 4; ++d) s->x[d] = 0;
+			getParticles().push_back(new Particle<RobotState>(s, 1.0 / particles));
+		}
+	}
+	~RobotParticleFilter() {
+		for (size_t i = 0; i < getParticles().size(); ++i) delete getParticles()[i];
+	}
+	void Transition() {
+		for (size_t i = 0; i < getParticles().size(); ++i) {
+			double *x = getParticles()[i]->getState()->x;
+			double ax = robot_noise * normal(), ay = robot_noise * normal();
+			x[0] += x[2] + ax / 2;
+			x[1] += x[3] + ay / 2;
+			x[2] += ax;
+			x[3] += ay;
+		}
+	}
+	void Likelihood() {
+		for (size_t i = 0; i < getParticles().size(); ++i) {
+			double *x = getParticles()[i]->getState()->x;
+			double dx = x[0] - observed[0], dy = x[1] - observed[1];
+			getParticles()[i]->setWeight(std::exp(-(dx * dx + dy * dy) / (2 * robot_observation * robot_observation)));
+		}
+	}
+	int EstimateColumns() { return 2; }
+	void GetColumns(RobotState & state, double *values) { values[0] = state.x[0]; values[1] = state.x[1]; }
+	double normal() {
+		return std::sqrt(-2 * std::log(1 - drand48())) * std::cos(2 * M_PI * drand48());
+	}
+	double observed[2];
+};
+
+//! The same observation model as a batch over the columns
+class RobotLikelihood: public VectorLikelihood<4, float> {
+public:
+	void operator()(float * const *columns, int begin, int end, double *weights) {
+		const float *x = columns[0], *y = columns[1];
+		float scale = -1 / (2 * robot_observation * robot_observation);
+		for (int i = begin; i < end; ++i) {
+			float dx = x[i] - observed[0], dy = y[i] - observed[1];
+			weights[i] = std::exp(scale * (dx * dx + dy * dy));
+		}
+	}
+	float observed[2];
+};
+
+//! A vector filter of which the motion model can be run on its own
+class TransitionProbeFilter: public VectorParticleFilter<3, double> {
+public:
+	TransitionProbeFilter(int particles): VectorParticleFilter<3, double>(particles) {}
+
+	//! Move all particles once
+	void Step() { Transition(0, getParticles()); }
+};
+
+/**
+ * Start all particles in the same point x and move them once. The sample mean should be A x + b and the
+ * sample covariance Q, within a few standard errors. The number of particles is not a multiple of
+ * TRANSITION_BLOCK, so the last block is partial. A covariance that is not positive definite should be
+ * rejected and leave the model as it was.
+ */
+void test_vector_filter_transition() {
+	cout << " === start test vector filter transition === " << endl;
+
+	int particles = 100000;
+	srand48(1);
+	TransitionProbeFilter filter(particles);
+	double A[9] = { 1, 0, 1,  0.5, 1, 0,  0, -0.2, 0.9 };
+	double b[3] = { 2, -1, 0.5 };
+	double Q[9] = { 4, 1, 0.5,  1, 2, -0.3,  0.5, -0.3, 1 };
+	double singular[9] = { 1, 1, 0,  1, 1, 0,  0, 0, 1 };
+	double negative[9] = { 1, 0, 0,  0, -1, 0,  0, 0, 1 };
+	bool accepted = filter.SetTransition(A, b, Q);
+	bool rejected = !filter.SetTransition(A, NULL, singular) && !filter.SetTransition(A, NULL, negative);
+	cout << "Positive definite noise accepted " << accepted << ", others rejected " << rejected << endl;
+	assert (accepted && rejected);
+
+	double x[3] = { 10, 20, -5 }, spread[3] = { 0, 0, 0 };
+	filter.Init(0, x, spread);
+	filter.Step();
+	double mean[3], covariance[3][3];
+	for (int d = 0; d < 3; ++d) {
+		const double *column = filter.getColumn(d);
+		mean[d] = 0;
+		for (int i = 0; i < particles; ++i) mean[d] += column[i];
+		mean[d] /= particles;
+	}
+	for (int d = 0; d < 3; ++d) {
+		for (int e = 0; e < 3; ++e) {
+			const double *cd = filter.getColumn(d), *ce = filter.getColumn(e);
+			covariance[d][e] = 0;
+			for (int i = 0; i < particles; ++i) covariance[d][e] += (cd[i] - mean[d]) * (ce[i] - mean[e]);
+			covariance[d][e] /= particles - 1;
+		}
+	}
+	for (int d = 0; d < 3; ++d) {
+		double expected = b[d];
+		for (int e = 0; e < 3; ++e) expected += A[d * 3 + e] * x[e];
+		cout << "Row " << d << ": mean " << mean[d] << " (" << expected << "), covariance";
+		for (int e = 0; e < 3; ++e) cout << " " << covariance[d][e] << " (" << Q[d * 3 + e] << ")";
+		cout << endl;
+		assert (std::fabs(mean[d] - expected) < 5 * std::sqrt(Q[d * 4] / particles));
+		for (int e = 0; e < 3; ++e) {
+			assert (std::fabs(covariance[d][e] - Q[d * 3 + e]) < 0.03 * std::sqrt(Q[d * 4] * Q[e * 4]));
+		}
+	}
+
+	cout << " === end test vector filter transition === " << endl;
+}
+
+/**
+ * Track the same trajectory with both engines and compare the time per particle per tick and the error of
+ * the estimated position. Both use systematic resampling.
+ */
+void test_vector_filter_benchmark() {
+	cout << " === start test vector filter benchmark === " << endl;
+
+	int particles = 100000, ticks = 50;
+	srand48(1);
+	std::vector<double> truth_x(ticks), truth_y(ticks), observed_x(ticks), observed_y(ticks);
+	double x = 0, y = 0, vx = 1, vy = 0.5;
+	for (int t = 0; t < ticks; ++t) {
+		x += vx; y += vy;
+		truth_x[t] = x; truth_y[t] = y;
+		double r = std::sqrt(-2 * std::log(1 - drand48())), a = 2 * M_PI * drand48();
+		observed_x[t] = x + robot_observation * r * std::cos(a);
+		observed_y[t] = y + robot_observation * r * std::sin(a);
+	}
+
+	RobotParticleFilter pointer_filter(particles);
+	double error = 0;
+	clock_t start = clock();
+	for (int t = 0; t < ticks; ++t) {
+		pointer_filter.observed[0] = observed_x[t];
+		pointer_filter.observed[1] = observed_y[t];
+		pointer_filter.Transition();
+		pointer_filter.Likelihood();
+		pointer_filter.Resample(drand48());
+		const ParticleEstimate & e = pointer_filter.GetEstimate();
+		error += std::sqrt(std::pow(e.mean[0] - truth_x[t], 2) + std::pow(e.mean[1] - truth_y[t], 2));
+	}
+	double pointer_time = double(clock() - start) / CLOCKS_PER_SEC;
+	cout << "ParticleFilter: " << 1e9 * pointer_time / (particles * ticks) << " ns per particle, error ";
+	cout << error / ticks << endl;
+
+	VectorParticleFilter<4, float> vector_filter(particles);
+	float A[16] = { 1, 0, 1, 0,  0, 1, 0, 1,  0, 0, 1, 0,  0, 0, 0, 1 };
+	float q = robot_noise * robot_noise;
+	float Q[16] = { q/4, 0, q/2, 0,  0, q/4, 0, q/2,  q/2, 0, q, 0,  0, q/2, 0, q };
+	// the noise on position and velocity is fully correlated, which is not positive definite, so add a little
+	for (int d = 0; d < 4; ++d) Q[d * 5] += 1e-4;
+	if (!vector_filter.SetTransition(A, NULL, Q)) {
+		cerr << "The transition noise is not positive definite" << endl;
+		return;
+	}
+	RobotLikelihood likelihood;
+	vector_filter.SetLikelihood(&likelihood);
+	float mean[4] = { 0, 0, 0, 0 }, spread[4] = { 0, 0, 0, 0 };
+	vector_filter.Init(0, mean, spread);
+	error = 0;
+	start = clock();
+	for (int t = 0; t < ticks; ++t) {
+		likelihood.observed[0] = observed_x[t];
+		likelihood.observed[1] = observed_y[t];
+		vector_filter.Tick();
+		error += std::sqrt(std::pow(vector_filter.GetMean(0, 0) - truth_x[t], 2) +
+				std::pow(vector_filter.GetMean(0, 1) - truth_y[t], 2));
+	}
+	double vector_time = double(clock() - start) / CLOCKS_PER_SEC;
+	cout << "VectorParticleFilter: " << 1e9 * vector_time / (particles * ticks) << " ns per particle, error ";
+	cout << error / ticks << endl;
+	cout << "Speed-up " << pointer_time / vector_time << endl;
+
+	cout << " === end test vector filter benchmark === " << endl;
+}
+
+#endif /* TESTVECTORFILTER_H_ */